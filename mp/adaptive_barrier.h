@@ -0,0 +1,272 @@
+#ifndef INC_ADAPTIVE_BARRIER_H
+#define INC_ADAPTIVE_BARRIER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "counter_barrier.h"
+#include "combining_tree.h"
+#include "mcs_tree.h"
+
+/*
+    A barrier that runs one of several algorithms at a time and moves to
+    whichever the measurements predict to be fastest for the live team.
+
+    Every algorithm is crossed with a hook run by the thread completing the
+    episode, once everyone has arrived and before anyone is released. That
+    thread alone maintains the statistics and decides which algorithm the
+    next episode uses, so the decision is taken inside the barrier: all
+    threads read the new choice after being released from this episode and
+    before arriving at the next, and none can be left behind in the old
+    algorithm when it is used again, since that takes one more episode that
+    everybody has to arrive at.
+
+    The hook counts episodes, and every window of N episodes reads the clock
+    once and updates the estimate of the current algorithm (ns per episode,
+    work in between included, which is the same for every algorithm under a
+    steady workload). The barrier starts with a probe round, one window per
+    algorithm, then runs the best one and probes again every M windows. It
+    switches only if the best estimate beats the current one by a margin.
+
+    Environment:
+        GTMP_ADAPTIVE_ALGO      counter, combining or mcs: no switching
+        GTMP_ADAPTIVE_WINDOW    episodes per measurement (default 256)
+        GTMP_ADAPTIVE_REPROBE   windows between probe rounds (default 64)
+*/
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class GenericAdaptiveBarrier
+{
+public:
+
+    enum Algo : unsigned
+    {
+        Counter,
+        Combining,
+        Mcs,
+        kNumAlgos
+    };
+
+    static constexpr unsigned kDefaultWindow = 256;
+    static constexpr unsigned kDefaultReprobe = 64;
+
+    // Switch only if the best estimate is below this fraction of the current one.
+    static constexpr double kSwitchMargin = 0.95;
+
+    static const char * get_name(unsigned algo)
+    {
+        static const char * names[kNumAlgos] = { "counter", "combining", "mcs" };
+        BOOST_ASSERT(algo < kNumAlgos);
+        return names[algo];
+    }
+
+    GenericAdaptiveBarrier() = default;
+
+    GenericAdaptiveBarrier(const GenericAdaptiveBarrier &) = delete;
+    GenericAdaptiveBarrier & operator=(const GenericAdaptiveBarrier &) = delete;
+
+    // Must be called outside of any parallel region, see node_arena.h.
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        m_counter.init(num_threads);
+        m_combining.init(num_threads);
+        m_mcs.init(num_threads);
+
+        m_stats = Stats();
+        m_stats.window = read_env_unsigned("GTMP_ADAPTIVE_WINDOW", kDefaultWindow);
+        m_stats.reprobe = read_env_unsigned("GTMP_ADAPTIVE_REPROBE", kDefaultReprobe);
+        m_stats.window_start = now_ns();
+
+        unsigned algo = 0;
+        m_stats.pinned = read_pinned_algo(algo);
+        m_stats.probing = !m_stats.pinned;
+        m_current.store(algo, std::memory_order_relaxed);
+    }
+
+    void barrier(int thread_id)
+    {
+        auto hook = [this] { on_complete(); };
+
+        // Written only by the hook, before the release of the previous
+        // episode, so every thread reads the same value here.
+        switch (m_current.load(std::memory_order_relaxed))
+        {
+        case Counter:
+            m_counter.barrier(hook);
+            break;
+        case Combining:
+            m_combining.barrier(thread_id, hook);
+            break;
+        default:
+            m_mcs.barrier(thread_id, hook);
+            break;
+        }
+    }
+
+    // For reports, only meaningful outside of a parallel region.
+    unsigned get_current() const
+    {
+        return m_current.load(std::memory_order_relaxed);
+    }
+
+    uint64_t get_num_switches() const
+    {
+        return m_stats.num_switches;
+    }
+
+    bool is_pinned() const
+    {
+        return m_stats.pinned;
+    }
+
+    // ns per episode, or a negative value if never measured.
+    double get_estimate(unsigned algo) const
+    {
+        BOOST_ASSERT(algo < kNumAlgos);
+        return m_stats.estimates[algo];
+    }
+
+private:
+
+    void on_complete()
+    {
+        Stats & s = m_stats;
+
+        if (s.pinned || ++s.episodes < s.window)
+        {
+            return;
+        }
+
+        const unsigned current = m_current.load(std::memory_order_relaxed);
+        const uint64_t now = now_ns();
+        const double ns = double(now - s.window_start) / s.episodes;
+
+        double & estimate = s.estimates[current];
+        estimate = estimate < 0 ? ns : (estimate + ns) / 2;
+
+        unsigned next = current;
+
+        if (s.probing)
+        {
+            // One window per algorithm, in order, then settle on the best.
+            if (++s.num_probed < kNumAlgos)
+            {
+                next = (current + 1) % kNumAlgos;
+            }
+            else
+            {
+                s.probing = false;
+                s.num_probed = 0;
+                next = pick(s.settled);
+                s.settled = next;
+            }
+        }
+        else if (++s.windows_since_probe >= s.reprobe)
+        {
+            // This window was the incumbent's turn of the new round.
+            s.probing = true;
+            s.num_probed = 1;
+            s.windows_since_probe = 0;
+            next = (current + 1) % kNumAlgos;
+        }
+
+        if (next != current)
+        {
+            m_current.store(next, std::memory_order_relaxed);
+            ++s.num_switches;
+        }
+
+        s.episodes = 0;
+        s.window_start = now_ns();
+    }
+
+    // Fastest estimate, unless it does not beat the incumbent by the margin.
+    unsigned pick(unsigned incumbent) const
+    {
+        unsigned best = incumbent;
+        for (unsigned a = 0; a < kNumAlgos; ++a)
+        {
+            const double est = m_stats.estimates[a];
+            if (est >= 0 && est < m_stats.estimates[best] * kSwitchMargin)
+            {
+                best = a;
+            }
+        }
+        return best;
+    }
+
+    static uint64_t now_ns()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static unsigned read_env_unsigned(const char * name, unsigned fallback)
+    {
+        const char * env = std::getenv(name);
+        if (!env)
+        {
+            return fallback;
+        }
+        return static_cast<unsigned>(std::max(1, std::atoi(env)));
+    }
+
+    static bool read_pinned_algo(unsigned & algo)
+    {
+        const char * env = std::getenv("GTMP_ADAPTIVE_ALGO");
+        if (!env)
+        {
+            return false;
+        }
+
+        for (unsigned a = 0; a < kNumAlgos; ++a)
+        {
+            if (std::string(env) == get_name(a))
+            {
+                algo = a;
+                return true;
+            }
+        }
+
+        std::cerr << "gtmp: ignoring unknown GTMP_ADAPTIVE_ALGO \"" + std::string(env) + "\", expected counter, combining or mcs\n";
+        return false;
+    }
+
+    // Only touched by the thread completing an episode, one at a time.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Stats
+    {
+        unsigned window = kDefaultWindow;
+        unsigned reprobe = kDefaultReprobe;
+        unsigned episodes = 0;              // In the current window
+        uint64_t window_start = 0;
+        double estimates[kNumAlgos] = { -1, -1, -1 };
+        bool pinned = false;
+        bool probing = false;
+        unsigned num_probed = 0;            // Windows of the current probe round
+        unsigned settled = 0;               // Choice of the last probe round
+        unsigned windows_since_probe = 0;
+        uint64_t num_switches = 0;
+    };
+
+    // Read by every thread at every crossing, on a line of its own.
+    alignas(LEVEL1_DCACHE_LINESIZE) std::atomic<unsigned> m_current{ 0 };
+
+    Stats m_stats;
+
+    alignas(LEVEL1_DCACHE_LINESIZE) CounterBarrier<WaitPolicy> m_counter;
+    GenericCombiningTree<4, WaitPolicy, Layout> m_combining;
+    GenericMcsTree<4, 2, WaitPolicy, Layout> m_mcs;
+};
+
+using AdaptiveBarrier = GenericAdaptiveBarrier<>;
+
+#endif
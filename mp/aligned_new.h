@@ -0,0 +1,41 @@
+#ifndef INC_ALIGNED_NEW_H
+#define INC_ALIGNED_NEW_H
+
+#include <new>
+#include <utility>
+
+#include <boost/align/aligned_alloc.hpp>
+
+// Before C++17, new ignores alignas beyond alignof(max_align_t), so objects
+// aligned to cache lines are created and destroyed through these instead.
+template <class T, class... Args>
+T * aligned_new(Args &&... args)
+{
+    void * mem = boost::alignment::aligned_alloc(alignof(T), sizeof(T));
+    if (!mem)
+    {
+        throw std::bad_alloc();
+    }
+
+    try
+    {
+        return new (mem) T(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        boost::alignment::aligned_free(mem);
+        throw;
+    }
+}
+
+template <class T>
+void aligned_delete(T * obj)
+{
+    if (obj)
+    {
+        obj->~T();
+        boost::alignment::aligned_free(obj);
+    }
+}
+
+#endif
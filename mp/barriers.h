@@ -0,0 +1,216 @@
+#ifndef INC_BARRIERS_H
+#define INC_BARRIERS_H
+
+#include <type_traits>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "node_arena.h"
+#include "thread_id.h"
+#include "counter_barrier.h"
+#include "sharded_counter_barrier.h"
+#include "combining_tree.h"
+#include "dynamic_tree.h"
+#include "mcs_tree.h"
+#include "dissemination_barrier.h"
+#include "tournament_barrier.h"
+#include "adaptive_barrier.h"
+#include "hierarchical_barrier.h"
+
+/*
+    Header-only front end of the barriers, for C++ code that wants the
+    crossing inlined into its loop rather than a call into a gtmp_*.cpp
+    through the C entry points of gtmp.h, which are thin wrappers of these.
+
+    Every barrier is a class template over
+        WaitPolicy  what a waiting thread does, see wait_policy.h
+        Layout      where the per-thread state goes, see node_arena.h
+        ThreadId    where the id of the crossing thread comes from, see thread_id.h
+    and models the same Barrier concept:
+
+        B barrier(num_threads);     outside of any parallel region, the
+                                    constructor may run one to place nodes
+        barrier.barrier();          by every thread of the team, each episode
+        barrier.barrier(thread_id); same, with the id passed in by the caller
+        barrier.get_num_threads();
+        barrier.get_algorithm();    the algorithm itself, e.g. for split-phase
+                                    crossings, reductions or statistics
+
+    The counter, combining and MCS barriers also take a completion step, as
+    the CompletionFunction of C++20 std::barrier:
+
+        r = barrier.barrier_complete(f);            the last thread in runs f()
+        r = barrier.barrier_complete(thread_id, f); before anyone leaves, and
+                                                    all get the value it returned,
+                                                    if f() returns one
+
+    Barriers are aligned to cache lines, create them on the heap with
+    aligned_new() (see aligned_new.h).
+*/
+
+namespace BarrierDetails
+{
+    // Whether the algorithm needs to know which thread is crossing.
+    template <class Algo>
+    struct NeedsThreadId
+    {
+        static constexpr bool value = true;
+    };
+
+    template <class WaitPolicy>
+    struct NeedsThreadId< CounterBarrier<WaitPolicy> >
+    {
+        static constexpr bool value = false;
+    };
+
+    template <class WaitPolicy>
+    void cross(CounterBarrier<WaitPolicy> & algo, int)
+    {
+        algo.barrier();
+    }
+
+    template <class Algo>
+    void cross(Algo & algo, int thread_id)
+    {
+        algo.barrier(thread_id);
+    }
+
+    // Only looks the id up, and only instantiates the lookup, if it is needed.
+    template <class Barrier>
+    int get_thread_id(Barrier & barrier, std::true_type)
+    {
+        return barrier.get_thread_id();
+    }
+
+    template <class Barrier>
+    int get_thread_id(Barrier &, std::false_type)
+    {
+        return 0;
+    }
+
+    template <class Algo, class Barrier>
+    int get_thread_id(Barrier & barrier)
+    {
+        return get_thread_id(barrier, std::integral_constant<bool, NeedsThreadId<Algo>::value>());
+    }
+
+    template <class WaitPolicy, class Completion>
+    CompletionResult<Completion> complete(CounterBarrier<WaitPolicy> & algo, int, Completion && completion)
+    {
+        return algo.barrier_complete(completion);
+    }
+
+    template <class Algo, class Completion>
+    CompletionResult<Completion> complete(Algo & algo, int thread_id, Completion && completion)
+    {
+        return algo.barrier_complete(thread_id, completion);
+    }
+}
+
+// Any algorithm with init(num_threads) and barrier(thread_id) as a Barrier.
+template <class Algo, class ThreadId = DefaultThreadId>
+class alignas(LEVEL1_DCACHE_LINESIZE) TeamBarrier
+{
+public:
+
+    using Algorithm = Algo;
+
+    explicit TeamBarrier(int num_threads) :
+        m_num_threads(num_threads),
+        m_thread_ids(num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+        m_algo.init(num_threads);
+    }
+
+    TeamBarrier(const TeamBarrier &) = delete;
+    TeamBarrier & operator=(const TeamBarrier &) = delete;
+
+    void barrier()
+    {
+        // No id lookup at all for the algorithms that do not need one.
+        BarrierDetails::cross(m_algo, BarrierDetails::get_thread_id<Algo>(*this));
+    }
+
+    void barrier(int thread_id)
+    {
+        BOOST_ASSERT(thread_id >= 0 && thread_id < m_num_threads);
+        BarrierDetails::cross(m_algo, thread_id);
+    }
+
+    // Barrier with a completion step, see barrier_complete() of the algorithms.
+    template <class Completion>
+    CompletionResult<Completion> barrier_complete(Completion && completion)
+    {
+        return BarrierDetails::complete(m_algo, BarrierDetails::get_thread_id<Algo>(*this), completion);
+    }
+
+    template <class Completion>
+    CompletionResult<Completion> barrier_complete(int thread_id, Completion && completion)
+    {
+        BOOST_ASSERT(thread_id >= 0 && thread_id < m_num_threads);
+        return BarrierDetails::complete(m_algo, thread_id, completion);
+    }
+
+    int get_num_threads() const
+    {
+        return m_num_threads;
+    }
+
+    // Id of the calling thread, from the ThreadId source of this barrier,
+    // e.g. for the split-phase crossings of get_algorithm().
+    int get_thread_id()
+    {
+        const int thread_id = m_thread_ids.get();
+        BOOST_ASSERT(thread_id >= 0 && thread_id < m_num_threads);
+        return thread_id;
+    }
+
+    Algo & get_algorithm()
+    {
+        return m_algo;
+    }
+
+    const Algo & get_algorithm() const
+    {
+        return m_algo;
+    }
+
+private:
+
+    Algo m_algo;
+    int m_num_threads;
+    ThreadId m_thread_ids;
+};
+
+
+// The counter has no per-thread state, Layout is only there for a uniform signature.
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using CounterTeamBarrier = TeamBarrier<CounterBarrier<WaitPolicy>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using ShardedTeamBarrier = TeamBarrier<ShardedCounterBarrier<WaitPolicy, Layout>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using CombiningTeamBarrier = TeamBarrier<GenericCombiningTree<GTMP_TREE_FANIN, WaitPolicy, Layout>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using DynamicTeamBarrier = TeamBarrier<GenericDynamicTree<4, WaitPolicy, Layout>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using McsTeamBarrier = TeamBarrier<GenericMcsTree<4, 2, WaitPolicy, Layout>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using DisseminationTeamBarrier = TeamBarrier<DisseminationBarrier<WaitPolicy, Layout>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using TournamentTeamBarrier = TeamBarrier<TournamentBarrier<WaitPolicy, Layout>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using AdaptiveTeamBarrier = TeamBarrier<GenericAdaptiveBarrier<WaitPolicy, Layout>, ThreadId>;
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout, class ThreadId = DefaultThreadId>
+using HierarchicalTeamBarrier = TeamBarrier<GenericHierarchicalBarrier<WaitPolicy, Layout>, ThreadId>;
+
+#endif
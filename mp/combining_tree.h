@@ -0,0 +1,505 @@
+#ifndef INC_COMBINING_TREE_H
+#define INC_COMBINING_TREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "node_arena.h"
+#include "reduce_ops.h"
+
+/*
+
+    From the MCS Paper: A software combining tree barrier with optimized wakeup
+
+    type node = record
+        k : integer //fan in of this node
+	count : integer // initialized to k
+	locksense : Boolean // initially false
+	parent : ^node // pointer to parent node; nil if root
+
+	shared nodes : array [0..P-1] of node
+	    //each element of nodes allocated in a different memory module or cache line
+
+	processor private sense : Boolean := true
+	processor private mynode : ^node // my group's leaf in the combining tree
+
+	procedure combining_barrier
+	    combining_barrier_aux (mynode) // join the barrier
+	    sense := not sense             // for next barrier
+
+
+	procedure combining_barrier_aux (nodepointer : ^node)
+	    with nodepointer^ do
+	        if fetch_and_decrement (&count) = 1 // last one to reach this node
+		    if parent != nil
+		        combining_barrier_aux (parent)
+		    count := k // prepare for next barrier
+		    locksense := not locksense // release waiting processors
+		repeat until locksense = sense
+*/
+
+/*
+    Variant implemented here, k-ary and iterative, behind gtmp_tree.cpp.
+
+    BasicCombiningTree is the algorithm, shared by every combining tree of
+    the repo. It links nodes by index and leaves their storage to the class
+    deriving from it, which provides
+        Node & get_node(unsigned i);        i in 0 .. get_num_nodes(P) - 1
+        State & get_state(int thread_id);   one per thread, on its own line
+    GenericCombiningTree keeps them in node arenas (node_arena.h), the memory
+    modules of the paper, and ShmCombiningTree (shm_barriers.h) right after
+    itself in a block of process-shared memory.
+
+    - FanIn consecutive threads share a leaf, and the tree is built level by
+      level with exactly ceil(n / FanIn) nodes above n, so there are no empty
+      nodes for a P that is not a power of FanIn. k is the real number of
+      children of a node. A node is placed near the first thread below it.
+
+    - The recursion is unrolled: a thread climbs while it is the last one to
+      reach a node. locksense is replaced by an episode counter per node, and
+      a thread that stops climbing at a node that is not complete yet returns
+      from arrive() instead of spinning there (split-phase). Its wait() spins
+      on that node, then releases the nodes it completed below it, top-down.
+
+    - GTMP_TREE_RELEASE=global: the thread completing the root bumps a single
+      shared episode that every thread spins on, instead of the release going
+      back down the tree. Release is one store, at the price of all threads
+      reading the same line. The default is tree.
+
+    - Reductions: every arriver leaves its value in its slot of the node before
+      decrementing count, the last one combines the slots and carries the
+      result up. The result, or that of a completion step, goes back down with
+      the release.
+
+    The fan-in of the trees that do not pick theirs is GTMP_TREE_FANIN, 4
+    unless built with e.g. make TREE_FANIN=2 (after make clean).
+*/
+
+#ifndef GTMP_TREE_FANIN
+#define GTMP_TREE_FANIN 4
+#endif
+
+template <class Derived, unsigned FanIn, class WaitPolicy>
+class alignas(LEVEL1_DCACHE_LINESIZE) BasicCombiningTree
+{
+    static_assert(FanIn >= 2, "");
+
+public:
+
+    using Token = typename WaitWord<WaitPolicy>::Word;
+
+    static constexpr unsigned kFanIn = FanIn;
+    static constexpr unsigned kMaxLevels = 32;
+
+    void barrier(int thread_id)
+    {
+        barrier(thread_id, [] {});
+    }
+
+    // The thread completing the root runs root_hook() once everyone has
+    // arrived and before anyone is released (see adaptive_barrier.h).
+    template <class RootHook>
+    void barrier(int thread_id, RootHook && root_hook)
+    {
+        wait_impl<false>(thread_id, arrive_impl<false>(thread_id, 0, NoReduce(), [&root_hook](ReduceWord &) { root_hook(); }));
+    }
+
+    Token arrive(int thread_id)
+    {
+        return arrive_impl<false>(thread_id, 0, NoReduce(), [](ReduceWord &) {});
+    }
+
+    void wait(int thread_id, Token episode)
+    {
+        wait_impl<false>(thread_id, episode);
+    }
+
+    bool test(int thread_id, Token episode)
+    {
+        State & me = get_state(thread_id);
+
+        if (me.stop == kNone)
+        {
+            return true;
+        }
+
+        if (!is_reached(get_release_word(me).load(), episode))
+        {
+            return false;
+        }
+
+        finish<false>(thread_id, me, episode);
+        return true;
+    }
+
+    // Barrier fused with a reduction: every thread contributes value, values
+    // are combined with op up the tree, and the result comes back down with
+    // the release to every thread. op must be associative and commutative,
+    // and all threads must pass the same op in an episode.
+    template <class T, class Op>
+    T barrier_reduce(int thread_id, const T & value, Op op)
+    {
+        const Token episode = arrive_impl<true>(thread_id, to_reduce_word(value), WordOp<T, Op>{ op }, [](ReduceWord &) {});
+        wait_impl<true>(thread_id, episode);
+
+        return from_reduce_word<T>( get_result(thread_id) );
+    }
+
+    // Barrier with a completion step, as the CompletionFunction of C++20
+    // std::barrier: the thread completing the root runs completion() before
+    // anyone is released, and what it returns comes back down with the
+    // releases to every thread (see reduce_ops.h for the types).
+    template <class Completion>
+    CompletionResult<Completion> barrier_complete(int thread_id, Completion && completion)
+    {
+        // Nothing comes down the tree for a completion that returns void.
+        constexpr bool kWithResult = !std::is_void< CompletionResult<Completion> >::value;
+
+        const Token episode = arrive_impl<kWithResult>(thread_id, 0, NoReduce(), [&completion](ReduceWord & value)
+        {
+            value = run_completion(completion);
+        });
+        wait_impl<kWithResult>(thread_id, episode);
+
+        return from_completion_word<Completion>( get_result(thread_id) );
+    }
+
+    bool is_global_release() const
+    {
+        return m_global_release;
+    }
+
+    // Exact node count: ceil(width / FanIn) nodes above every level, up to a single root.
+    static unsigned get_num_nodes(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        unsigned num_nodes = 0;
+        unsigned width = static_cast<unsigned>(num_threads);
+        do
+        {
+            width = (width + FanIn - 1) / FanIn;
+            num_nodes += width;
+        } while (width > 1);
+
+        return num_nodes;
+    }
+
+protected:
+
+    static constexpr unsigned kNone = ~0u;
+
+    // Where node i goes in the tree of num_threads, leaves first and the root last.
+    struct NodeShape
+    {
+        int owner;          // Team thread it is placed near
+        int k;
+        unsigned parent;
+        unsigned slot;
+    };
+
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Node
+    {
+        explicit Node(const NodeShape & shape) :
+            count(shape.k),
+            k(shape.k),
+            parent(shape.parent),
+            slot(shape.slot)
+        {
+
+        }
+
+        std::atomic<int> count;
+        int k;                          // Number of children (threads for a leaf) reporting here
+        unsigned parent;                // Index of the parent node, kNone for the root
+        unsigned slot;                  // Which of the parent's slots this node reports to
+        WaitWord<WaitPolicy> episode;   // Last episode this node was released for
+        ReduceWord result = 0;          // Valid once this node is released
+        ReduceWord slots[FanIn] = {};   // Values of the arrivers
+    };
+
+    // Only touched by its own thread.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) State
+    {
+        unsigned stop = kNone;          // Node to wait on, kNone once released or after completing the root
+        Token episode = 0;              // Last episode this thread arrived for
+    };
+
+    static std::vector<NodeShape> get_node_shapes(int num_threads)
+    {
+        std::vector<NodeShape> shapes;
+        shapes.reserve(get_num_nodes(num_threads));
+
+        // Node i of a level covers threads [i * span, (i + 1) * span).
+        unsigned base = 0;
+        unsigned width = static_cast<unsigned>(num_threads);
+        unsigned span = FanIn;
+        do
+        {
+            const unsigned w = (width + FanIn - 1) / FanIn;
+            for (unsigned i = 0; i < w; ++i)
+            {
+                const int k = static_cast<int>(std::min(FanIn, width - i * FanIn));
+                shapes.push_back({ static_cast<int>(i * span), k, w > 1 ? base + w + i / FanIn : kNone, i % FanIn });
+            }
+            base += w;
+            width = w;
+            span *= FanIn;
+        } while (width > 1);
+
+        return shapes;
+    }
+
+    // To be called by init(), along with building the nodes and states.
+    void init_release()
+    {
+        m_global_release = read_global_release();
+        m_release.episode.raw().store(0, std::memory_order_relaxed);
+        m_release.result = 0;
+    }
+
+    // Returns the episode arrived for. value is this thread's contribution,
+    // combined with op on the way up when ReduceOp::kEnabled, and root_hook(value)
+    // runs on the combined value, which is released with the episode when
+    // kWithResult.
+    template <bool kWithResult, class ReduceOp, class RootHook>
+    Token arrive_impl(int thread_id, ReduceWord value, ReduceOp op, RootHook && root_hook)
+    {
+        State & me = get_state(thread_id);
+        const Token episode = ++me.episode;
+
+        const unsigned leaf = static_cast<unsigned>(thread_id) / FanIn;
+        unsigned slot = static_cast<unsigned>(thread_id) % FanIn;
+        unsigned inode = leaf;
+
+        for (;;)
+        {
+            Node & node = get_node(inode);
+
+            if (ReduceOp::kEnabled)
+            {
+                node.slots[slot] = value;   // Published by the fetch_sub below
+            }
+
+            // The decrements of a node form a release sequence, so the thread
+            // completing it has acquired the writes of everyone below it.
+            if (node.count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                me.stop = inode;
+                return episode;
+            }
+
+            // Last one here: nobody arrives at this node again before it is released.
+            node.count.store(node.k, std::memory_order_relaxed);
+
+            if (ReduceOp::kEnabled)
+            {
+                value = node.slots[0];
+                for (int i = 1; i < node.k; ++i)
+                {
+                    value = op(value, node.slots[i]);
+                }
+            }
+
+            if (node.parent == kNone)
+            {
+                break;
+            }
+
+            slot = node.slot;
+            inode = node.parent;
+        }
+
+        // Completed the root: everyone has arrived.
+        root_hook(value);
+        me.stop = kNone;
+
+        if (m_global_release)
+        {
+            if (kWithResult)
+            {
+                m_release.result = value;
+            }
+            m_release.episode.store(episode);
+        }
+        else
+        {
+            if (kWithResult)
+            {
+                get_node(inode).result = value;
+            }
+            release_path(leaf, kNone, episode, kWithResult);
+        }
+
+        return episode;
+    }
+
+    template <bool kWithResult>
+    void wait_impl(int thread_id, Token episode)
+    {
+        State & me = get_state(thread_id);
+
+        if (me.stop != kNone)
+        {
+            get_release_word(me).wait_until([episode](Token cur) { return is_reached(cur, episode); });
+            finish<kWithResult>(thread_id, me, episode);
+        }
+    }
+
+    // Result released with the last episode thread_id waited for.
+    ReduceWord get_result(int thread_id)
+    {
+        return m_global_release ? m_release.result : get_node(static_cast<unsigned>(thread_id) / FanIn).result;
+    }
+
+private:
+
+    // Global release word, on its own line.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Release
+    {
+        WaitWord<WaitPolicy> episode;
+        ReduceWord result = 0;      // Written before episode
+    };
+
+    Node & get_node(unsigned i)
+    {
+        return static_cast<Derived *>(this)->get_node(i);
+    }
+
+    State & get_state(int thread_id)
+    {
+        return static_cast<Derived *>(this)->get_state(thread_id);
+    }
+
+    WaitWord<WaitPolicy> & get_release_word(const State & me)
+    {
+        return m_global_release ? m_release.episode : get_node(me.stop).episode;
+    }
+
+    template <bool kWithResult>
+    void finish(int thread_id, State & me, Token episode)
+    {
+        if (!m_global_release)
+        {
+            release_path(static_cast<unsigned>(thread_id) / FanIn, me.stop, episode, kWithResult);
+        }
+        me.stop = kNone;
+    }
+
+    // Releases the nodes from inode (included) up to stop (excluded), top-down.
+    // Results are not written again before everyone below has arrived for the
+    // next episode, which they do after reading them.
+    void release_path(unsigned inode, unsigned stop, Token episode, bool with_result)
+    {
+        unsigned path[kMaxLevels];
+        unsigned depth = 0;
+
+        for (; inode != stop; inode = get_node(inode).parent)
+        {
+            BOOST_ASSERT(depth < kMaxLevels);
+            path[depth++] = inode;
+        }
+
+        while (depth > 0)
+        {
+            Node & node = get_node(path[--depth]);
+            if (with_result && node.parent != kNone)
+            {
+                node.result = get_node(node.parent).result;
+            }
+            node.episode.store(episode);
+        }
+    }
+
+    // Wrap-around safe "cur >= episode".
+    static bool is_reached(Token cur, Token episode)
+    {
+        return static_cast<int32_t>(cur - episode) >= 0;
+    }
+
+    static bool read_global_release()
+    {
+        const char * env = std::getenv("GTMP_TREE_RELEASE");
+        if (!env || std::string(env) == "tree")
+        {
+            return false;
+        }
+        if (std::string(env) == "global")
+        {
+            return true;
+        }
+
+        std::cerr << "gtmp: ignoring unknown GTMP_TREE_RELEASE \"" + std::string(env) + "\", expected tree or global\n";
+        return false;
+    }
+
+    bool m_global_release = false;
+    Release m_release;
+};
+
+
+template <unsigned FanIn = GTMP_TREE_FANIN, class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class GenericCombiningTree : public BasicCombiningTree<GenericCombiningTree<FanIn, WaitPolicy, Layout>, FanIn, WaitPolicy>
+{
+    using Base = BasicCombiningTree<GenericCombiningTree, FanIn, WaitPolicy>;
+    friend Base;
+
+    using typename Base::Node;
+    using typename Base::NodeShape;
+    using typename Base::State;
+
+public:
+
+    GenericCombiningTree() = default;
+
+    // Must be called outside of any parallel region, see node_arena.h.
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        const std::vector<NodeShape> shapes = Base::get_node_shapes(num_threads);
+
+        m_nodes.create(shapes.size(), num_threads,
+            [&shapes](size_t i) { return shapes[i].owner; },
+            [&shapes](size_t i, void * mem) { new (mem) Node(shapes[i]); });
+
+        m_states.create(static_cast<size_t>(num_threads), num_threads,
+            [](size_t i) { return static_cast<int>(i); },
+            [](size_t, void * mem) { new (mem) State(); });
+
+        Base::init_release();
+    }
+
+    int get_num_threads() const
+    {
+        return static_cast<int>(m_states.size());
+    }
+
+private:
+
+    Node & get_node(unsigned i)
+    {
+        return m_nodes[i];
+    }
+
+    State & get_state(int thread_id)
+    {
+        BOOST_ASSERT(thread_id >= 0 && thread_id < get_num_threads());
+        return m_states[static_cast<size_t>(thread_id)];
+    }
+
+    ArenaArray<Node, Layout> m_nodes;       // Leaves first, root last
+    ArenaArray<State, Layout> m_states;
+};
+
+using CombiningTree = GenericCombiningTree<>;
+
+#endif
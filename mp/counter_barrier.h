@@ -0,0 +1,160 @@
+#ifndef INC_COUNTER_BARRIER_H
+#define INC_COUNTER_BARRIER_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "reduce_ops.h"
+
+/*
+    From the MCS Paper: A sense-reversing centralized barrier
+
+    shared count : integer := P
+    shared sense : Boolean := true
+    processor private local_sense : Boolean := true
+
+    procedure central_barrier
+        local_sense := not local_sense // each processor toggles its own sense
+	if fetch_and_decrement (&count) = 1
+	    count := P
+	    sense := local_sense // last processor toggles global sense
+        else
+           repeat until sense = local_sense
+*/
+
+/*
+    Split-phase variant: the shared sense is replaced by an episode counter,
+    so a waiter compares against the episode it arrived for instead of a bit
+    that flips back every other barrier.
+
+    arrive:
+        episode := shared episode + 1
+        if fetch_and_decrement (&count) = 1
+            count := P
+            shared episode := episode
+        return episode
+
+    wait (episode):
+        repeat until shared episode = episode
+*/
+
+template <class WaitPolicy = DefaultWaitPolicy>
+class CounterBarrier
+{
+public:
+    using Token = typename WaitWord<WaitPolicy>::Word;
+
+    CounterBarrier(int num_threads = 1) :
+        m_num_threads(num_threads),
+        m_count(num_threads),
+        m_episode(0)
+    {
+        BOOST_ASSERT(num_threads > 0);
+    }
+
+    // Resizes the team, only while no thread is crossing.
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        m_num_threads = num_threads;
+        m_count.store(num_threads);
+    }
+
+    void barrier()
+    {
+        barrier([] {});
+    }
+
+    // Same as barrier(), but the last thread to arrive runs last_hook()
+    // before releasing the others.
+    template <class LastHook>
+    void barrier(LastHook && last_hook)
+    {
+        wait(arrive(last_hook));
+    }
+
+    // Barrier with a completion step, as the CompletionFunction of C++20
+    // std::barrier: the last thread to arrive runs completion() before
+    // releasing the others, and every thread gets back what it returned.
+    // The result is void or any trivially copyable type of up to 8 bytes,
+    // see reduce_ops.h.
+    template <class Completion>
+    CompletionResult<Completion> barrier_complete(Completion && completion)
+    {
+        // Written before the release of the episode, and not again before
+        // every thread has arrived for the next one, i.e. read this one.
+        wait(arrive([this, &completion] { m_result = run_completion(completion); }));
+
+        return from_completion_word<Completion>(m_result);
+    }
+
+    Token arrive()
+    {
+        return arrive([] {});
+    }
+
+    template <class LastHook>
+    Token arrive(LastHook && last_hook)
+    {
+        // The episode is read from the shared word instead of being kept in a
+        // thread_local, so that several instances can coexist. It cannot advance
+        // before this thread has decremented the count.
+        const Token episode = m_episode.load(std::memory_order_relaxed) + 1;
+
+        // Release this thread's writes to the last arriver, and acquire
+        // everybody's for it: the decrements form one release sequence.
+        int prev = m_count.fetch_sub(1, std::memory_order_acq_rel);
+
+        if (prev == 1)
+        {
+            // Ordered before the next arrivals by the release store below.
+            m_count.store(m_num_threads, std::memory_order_relaxed);
+            last_hook();
+            m_episode.store(episode);
+        }
+
+        return episode;
+    }
+
+    void wait(Token episode)
+    {
+        // The count doubles as the number of arrivals still expected, for
+        // backoff policies proportional to it.
+        const int remaining = m_count.load(std::memory_order_relaxed);
+
+        m_episode.wait_until([episode](Token cur) { return is_reached(cur, episode); },
+                             static_cast<unsigned>(std::max(remaining, 0)));
+    }
+
+    bool test(Token episode) const
+    {
+        return is_reached(m_episode.load(), episode);
+    }
+
+    int get_num_threads() const
+    {
+        return m_num_threads;
+    }
+
+private:
+
+    // Wrap-around safe "cur >= episode".
+    static bool is_reached(Token cur, Token episode)
+    {
+        return static_cast<int32_t>(cur - episode) >= 0;
+    }
+
+    int m_num_threads;
+    std::atomic<int> m_count;
+    WaitWord<WaitPolicy> m_episode;
+    ReduceWord m_result = 0;    // Of the completion step, next to the episode it comes with
+
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef INC_CPU_TOPOLOGY_H
+#define INC_CPU_TOPOLOGY_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <tuple>
+
+#include <sched.h>
+#include <dirent.h>
+
+// Where one logical CPU sits in the machine, as reported by
+// /sys/devices/system/cpu/cpuN/topology and the cpuN/nodeM links.
+struct CpuInfo
+{
+    int cpu = 0;
+    int package = 0;    // physical socket
+    int core = 0;       // core id, only unique within a package
+    int node = 0;       // NUMA node
+
+    friend bool operator<(const CpuInfo & a, const CpuInfo & b)
+    {
+        return std::tie(a.package, a.node, a.core, a.cpu) < std::tie(b.package, b.node, b.core, b.cpu);
+    }
+};
+
+namespace CpuTopologyDetails
+{
+    inline int read_int_file(const std::string & path, int fallback)
+    {
+        std::ifstream ifs(path);
+        int val = fallback;
+        if (!(ifs >> val))
+        {
+            return fallback;
+        }
+        return val;
+    }
+
+    inline int read_numa_node(int cpu)
+    {
+        const std::string dir_name = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+
+        DIR * dir = opendir(dir_name.c_str());
+        if (!dir)
+        {
+            return 0;
+        }
+
+        int node = 0;
+        while (dirent * entry = readdir(dir))
+        {
+            const std::string name(entry->d_name);
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            {
+                node = std::stoi(name.substr(4));
+                break;
+            }
+        }
+
+        closedir(dir);
+        return node;
+    }
+}
+
+inline CpuInfo read_cpu_info(int cpu)
+{
+    using namespace CpuTopologyDetails;
+
+    const std::string topo = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+
+    CpuInfo info;
+    info.cpu = cpu;
+    info.package = read_int_file(topo + "physical_package_id", 0);
+    info.core = read_int_file(topo + "core_id", cpu);
+    info.node = read_numa_node(cpu);
+    return info;
+}
+
+// Number of NUMA nodes, from the /sys/devices/system/node/nodeN entries.
+// 1 if the kernel has no NUMA support.
+inline int read_num_numa_nodes()
+{
+    DIR * dir = opendir("/sys/devices/system/node");
+    if (!dir)
+    {
+        return 1;
+    }
+
+    int max_node = 0;
+    while (dirent * entry = readdir(dir))
+    {
+        const std::string name(entry->d_name);
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+            std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; }))
+        {
+            max_node = std::max(max_node, std::stoi(name.substr(4)));
+        }
+    }
+
+    closedir(dir);
+    return max_node + 1;
+}
+
+// CPUs this process may run on, ordered so that SMT siblings are adjacent,
+// then cores of the same NUMA node, then of the same package.
+inline std::vector<CpuInfo> read_allowed_cpus()
+{
+    std::vector<CpuInfo> cpus;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(read_cpu_info(cpu));
+            }
+        }
+    }
+
+    if (cpus.empty())
+    {
+        cpus.push_back(read_cpu_info(0));
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    return cpus;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef INC_DISSEMINATION_BARRIER_H
+#define INC_DISSEMINATION_BARRIER_H
+
+#include <atomic>
+#include <vector>
+#include <limits>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "node_arena.h"
+
+/*
+    From the MCS Paper: The scalable, distributed dissemination barrier with only local spinning.
+
+    type flags = record
+        myflags : array [0..1] of array [0..LogP-1] of Boolean
+        partnerflags : array [0..1] of array [0..LogP-1] of ^Boolean
+
+    processor private parity : integer := 0
+    processor private sense : Boolean := true
+    processor private localflags : ^flags
+
+    shared allnodes : array [0..P-1] of flags
+        // allnodes[i] is allocated in shared memory
+        // locally accessible to processor i
+
+    // on processor i, localflags points to allnodes[i]
+    // initially allnodes[i].myflags[r][k] is false for all i, r, k
+    // if j = (i+2^k) mod P, then for r = 0, 1:
+    //    allnodes[i].partnerflags[r][k] points to allnodes[j].myflags[r][k]
+
+    procedure dissemination_barrier
+        for instance : integer := 0 to LogP-1
+            localflags^.partnerflags[parity][instance]^ := sense
+            repeat until localflags^.myflags[parity][instance] = sense
+        if parity = 1
+            sense := not sense
+        parity := 1 - parity
+*/
+
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class DisseminationBarrier
+{
+    using Flag = WaitWord<WaitPolicy>;
+
+public:
+
+    // Enough rounds for 2^16 threads.
+    static constexpr unsigned kMaxRounds = 16;
+
+    DisseminationBarrier() = default;
+
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        const unsigned num_nodes = static_cast<unsigned>(num_threads);
+
+        m_num_rounds = 0;
+        while ((1u << m_num_rounds) < num_nodes)
+        {
+            ++m_num_rounds;
+        }
+        BOOST_ASSERT(m_num_rounds <= kMaxRounds);
+
+        // Node i is placed near thread i, partner pointers are filled in below.
+        m_nodes.create(num_nodes, num_threads,
+            [](size_t i) { return static_cast<int>(i); },
+            [](size_t, void * mem) { new (mem) Node(); });
+
+        for (unsigned i = 0; i < num_nodes; ++i)
+        {
+            Private & me = m_nodes[i].priv;
+
+            me.parity = 0;
+            me.sense = 1;
+
+            for (unsigned k = 0; k < m_num_rounds; ++k)
+            {
+                const unsigned j = (i + (1u << k)) % num_nodes;
+
+                for (unsigned r = 0; r < 2; ++r)
+                {
+                    me.partner_flags[r][k] = &(m_nodes[j].flags.my_flags[r][k]);
+                }
+            }
+        }
+    }
+
+    void barrier(int thread_id)
+    {
+        BOOST_ASSERT(thread_id >= 0);
+        BOOST_ASSERT(static_cast<size_t>(thread_id) < m_nodes.size());
+
+        Node & node = m_nodes[static_cast<size_t>(thread_id)];
+        Private & me = node.priv;
+
+        Flag * const * partner_flags = me.partner_flags[me.parity];
+        Flag * my_flags = node.flags.my_flags[me.parity];
+
+        for (unsigned k = 0; k < m_num_rounds; ++k)
+        {
+            partner_flags[k]->store(me.sense);
+            my_flags[k].wait_until_equal(me.sense);
+        }
+
+        if (me.parity == 1)
+        {
+            me.sense = !me.sense;
+        }
+
+        me.parity = 1 - me.parity;
+    }
+
+private:
+
+    // Only touched by the owning thread. Kept on its own cache line so that
+    // partners writing into the flags do not invalidate it.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Private
+    {
+        Flag * partner_flags[2][kMaxRounds] = {};
+        unsigned parity = 0;
+        typename Flag::Word sense = 1;
+    };
+
+    // Spun on by the owner, written once per round by exactly one partner.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Flags
+    {
+        Flag my_flags[2][kMaxRounds];
+    };
+
+    struct Node
+    {
+        Private priv;
+        Flags flags;
+    };
+
+    ArenaArray<Node, Layout> m_nodes;
+    unsigned m_num_rounds = 0;
+};
+
+#endif
@@ -0,0 +1,342 @@
+#ifndef INC_DYNAMIC_TREE_H
+#define INC_DYNAMIC_TREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "node_arena.h"
+#include "tsc_clock.h"
+
+/*
+    A combining tree that moves the threads that keep arriving late toward
+    the root, after the adaptive combining trees of Gupta and Hill.
+
+    In the static trees (GenericCombiningTree, GenericMcsTree) every thread sits at
+    a fixed leaf, so the last arriver still climbs the whole tree after it
+    arrives. Here every node of a FanIn-ary heap is a slot for one thread:
+    a node counts its own thread plus its children, and whoever decrements
+    it to zero climbs on to the parent. The thread in slot 0 arrives at the
+    root directly. If it is the last one, as when a chronically late thread
+    has been moved there, the episode completes with one fetch_sub and the
+    release is one store to a global word: O(1) after the last arrival.
+
+    Every sample interval, threads stamp their arrival in their own line and
+    the thread completing the episode ranks them. Every reorganization
+    interval, that thread reassigns the slots by recent mean rank, latest
+    first in heap order (root, then its children, ...). This is done
+    in the completion hook, while all threads are waiting for the release,
+    so none of them is in the tree when slots change.
+
+    The sampling episodes read one line per thread, and reorganizations
+    sort the team, on the critical path of that episode. Both are amortized
+    over their intervals.
+
+    Environment:
+        GTMP_DYNAMIC_SAMPLE     episodes between samples, rounded up to a
+                                power of 2 (default 64)
+        GTMP_DYNAMIC_REORG      samples between reorganizations (default 32)
+        GTMP_DYNAMIC_STATIC     1 keeps collecting statistics, but never moves
+                                a thread, to measure what migration buys
+*/
+template <unsigned FanIn = 4, class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class GenericDynamicTree
+{
+    static_assert(FanIn >= 2, "");
+
+public:
+
+    using Token = typename WaitWord<WaitPolicy>::Word;
+
+    static constexpr unsigned kDefaultSampleInterval = 64;
+    static constexpr unsigned kDefaultReorgInterval = 32;
+
+    // Arrival order statistics of one thread, over all samples.
+    struct ArrivalStats
+    {
+        double mean_rank = 0;       // 0 is first, num_threads - 1 is last
+        double last_fraction = 0;   // Of the samples where it arrived last
+        unsigned slot = 0;          // Current node, 0 is the root
+        unsigned level = 0;         // Depth of that node
+    };
+
+    GenericDynamicTree() = default;
+
+    GenericDynamicTree(const GenericDynamicTree &) = delete;
+    GenericDynamicTree & operator=(const GenericDynamicTree &) = delete;
+
+    // Must be called outside of any parallel region, see node_arena.h.
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        const unsigned n = static_cast<unsigned>(num_threads);
+        m_num_threads = n;
+
+        // Rounded up to a power of 2, at most 2^31 so that the shift stays in range.
+        const unsigned sample_interval = std::min(read_env_unsigned("GTMP_DYNAMIC_SAMPLE", kDefaultSampleInterval), 1u << 31);
+        const unsigned shift = sample_interval <= 1 ? 0 : 32 - static_cast<unsigned>(__builtin_clz(sample_interval - 1));
+        m_sample_mask = (1u << shift) - 1;
+        m_reorg_interval = read_env_unsigned("GTMP_DYNAMIC_REORG", kDefaultReorgInterval);
+        m_static = read_env_unsigned("GTMP_DYNAMIC_STATIC", 0) != 0;
+
+        // Slots start out as thread ids. Nodes stay where their first owner
+        // runs, threads moved later spin on the global word anyway.
+        m_nodes.create(n, num_threads,
+            [](size_t i) { return static_cast<int>(i); },
+            [n](size_t i, void * mem)
+        {
+            Node * node = new (mem) Node();
+            const unsigned first_child = static_cast<unsigned>(i) * FanIn + 1;
+            node->k = 1 + static_cast<int>(first_child < n ? std::min(FanIn, n - first_child) : 0u);
+            node->count.store(node->k);
+            node->parent = i == 0 ? kNoParent : (static_cast<unsigned>(i) - 1) / FanIn;
+        });
+
+        m_threads.create(n, num_threads,
+            [](size_t i) { return static_cast<int>(i); },
+            [](size_t i, void * mem)
+        {
+            ThreadState * state = new (mem) ThreadState();
+            state->slot = static_cast<unsigned>(i);
+        });
+
+        m_order.resize(n);
+        m_window_rank_sum.assign(n, 0);
+        m_score.assign(n, 0);
+        m_rank_sum.assign(n, 0);
+        m_num_last.assign(n, 0);
+        m_num_samples = 0;
+        m_num_window_samples = 0;
+        m_num_reorgs = 0;
+        m_num_migrations = 0;
+    }
+
+    void barrier(int thread_id)
+    {
+        barrier(thread_id, [] {});
+    }
+
+    // The thread completing the root runs root_hook() once everyone has
+    // arrived and before anyone is released.
+    template <class RootHook>
+    void barrier(int thread_id, RootHook && root_hook)
+    {
+        ThreadState & state = m_threads[static_cast<unsigned>(thread_id)];
+
+        // The release cannot happen before this thread has arrived.
+        const Token episode = m_release.load(std::memory_order_relaxed) + 1;
+        const bool sampled = (episode & m_sample_mask) == 0;
+
+        if (sampled)
+        {
+            state.arrival = TscClock::now();
+        }
+
+        unsigned slot = state.slot;
+        for (;;)
+        {
+            Node & node = m_nodes[slot];
+            // As in the combining tree, acq_rel carries every arrival, and its
+            // sampled timestamp, up to the thread completing the root.
+            if (node.count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                m_release.wait_until([episode](Token cur) { return is_reached(cur, episode); });
+                return;
+            }
+
+            // Last one here: nobody arrives at this node again before the release.
+            node.count.store(node.k, std::memory_order_relaxed);
+
+            if (node.parent == kNoParent)
+            {
+                break;
+            }
+            slot = node.parent;
+        }
+
+        if (sampled)
+        {
+            on_sample();
+        }
+        root_hook();
+
+        m_release.store(episode);
+    }
+
+    int get_num_threads() const
+    {
+        return static_cast<int>(m_num_threads);
+    }
+
+    // Statistics are written by the thread completing the episodes, only
+    // read them outside of a parallel region.
+    ArrivalStats get_arrival_stats(int thread_id) const
+    {
+        const unsigned t = static_cast<unsigned>(thread_id);
+        BOOST_ASSERT(t < m_num_threads);
+
+        ArrivalStats stats;
+        if (m_num_samples > 0)
+        {
+            stats.mean_rank = double(m_rank_sum[t]) / double(m_num_samples);
+            stats.last_fraction = double(m_num_last[t]) / double(m_num_samples);
+        }
+        stats.slot = m_threads[t].slot;
+        for (unsigned s = stats.slot; s > 0; s = (s - 1) / FanIn)
+        {
+            ++stats.level;
+        }
+        return stats;
+    }
+
+    uint64_t get_num_samples() const
+    {
+        return m_num_samples;
+    }
+
+    uint64_t get_num_reorgs() const
+    {
+        return m_num_reorgs;
+    }
+
+    // Threads that changed slot, over all reorganizations.
+    uint64_t get_num_migrations() const
+    {
+        return m_num_migrations;
+    }
+
+private:
+
+    static constexpr unsigned kNoParent = ~0u;
+
+    // Wrap-around safe "cur >= episode".
+    static bool is_reached(Token cur, Token episode)
+    {
+        return static_cast<int32_t>(cur - episode) >= 0;
+    }
+
+    static unsigned read_env_unsigned(const char * name, unsigned fallback)
+    {
+        const char * env = std::getenv(name);
+        if (!env)
+        {
+            return fallback;
+        }
+        return static_cast<unsigned>(std::max(0, std::atoi(env)));
+    }
+
+    // Ranks the arrivals of this episode.
+    void on_sample()
+    {
+        const unsigned n = m_num_threads;
+
+        for (unsigned t = 0; t < n; ++t)
+        {
+            m_order[t] = t;
+        }
+        std::sort(m_order.begin(), m_order.end(), [this](unsigned a, unsigned b)
+        {
+            return m_threads[a].arrival < m_threads[b].arrival;
+        });
+
+        for (unsigned rank = 0; rank < n; ++rank)
+        {
+            m_window_rank_sum[m_order[rank]] += rank;
+            m_rank_sum[m_order[rank]] += rank;
+        }
+        ++m_num_last[m_order[n - 1]];
+        ++m_num_samples;
+
+        if (++m_num_window_samples >= std::max(m_reorg_interval, 1u))
+        {
+            if (!m_static)
+            {
+                reorganize();
+            }
+            std::fill(m_window_rank_sum.begin(), m_window_rank_sum.end(), 0);
+            m_num_window_samples = 0;
+        }
+    }
+
+    // Latest threads to the lowest slots, by mean rank over the last
+    // windows with the weight halving at each window, so that one noisy
+    // window does not reshuffle the tree. Ties keep their current order.
+    void reorganize()
+    {
+        const unsigned n = m_num_threads;
+
+        for (unsigned t = 0; t < n; ++t)
+        {
+            m_score[t] = m_score[t] / 2 + m_window_rank_sum[t];
+        }
+
+        for (unsigned t = 0; t < n; ++t)
+        {
+            m_order[m_threads[t].slot] = t;
+        }
+        std::stable_sort(m_order.begin(), m_order.end(), [this](unsigned a, unsigned b)
+        {
+            return m_score[a] > m_score[b];
+        });
+
+        bool moved = false;
+        for (unsigned slot = 0; slot < n; ++slot)
+        {
+            ThreadState & state = m_threads[m_order[slot]];
+            if (state.slot != slot)
+            {
+                state.slot = slot;
+                ++m_num_migrations;
+                moved = true;
+            }
+        }
+        m_num_reorgs += moved ? 1 : 0;
+    }
+
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Node
+    {
+        std::atomic<int> count{ 0 };
+        int k = 0;                  // Its thread plus its children
+        unsigned parent = kNoParent;
+    };
+
+    // Read by its thread at every crossing, written by others only while it
+    // waits for the release.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) ThreadState
+    {
+        unsigned slot = 0;
+        uint64_t arrival = 0;       // TSC, on sampled episodes
+    };
+
+    ArenaArray<Node, Layout> m_nodes;               // Heap order, root first
+    ArenaArray<ThreadState, Layout> m_threads;
+
+    alignas(LEVEL1_DCACHE_LINESIZE) WaitWord<WaitPolicy> m_release;
+
+    // Read-only after init.
+    alignas(LEVEL1_DCACHE_LINESIZE) unsigned m_num_threads = 0;
+    unsigned m_sample_mask = 0;
+    unsigned m_reorg_interval = kDefaultReorgInterval;
+    bool m_static = false;
+
+    // Only touched by the thread completing an episode, one at a time.
+    alignas(LEVEL1_DCACHE_LINESIZE) unsigned m_num_window_samples = 0;
+    uint64_t m_num_samples = 0;
+    uint64_t m_num_reorgs = 0;
+    uint64_t m_num_migrations = 0;
+    std::vector<unsigned> m_order;          // Scratch, allocated once
+    std::vector<uint64_t> m_window_rank_sum;
+    std::vector<uint64_t> m_score;
+    std::vector<uint64_t> m_rank_sum;
+    std::vector<uint64_t> m_num_last;
+};
+
+using DynamicTree = GenericDynamicTree<>;
+
+#endif
@@ -6,4 +6,37 @@ void gtmp_init(int num_threads);
 void gtmp_barrier();
 void gtmp_finalize();
 
+// Independent barrier instances, e.g. for nested teams or pipelines.
+// Threads are identified by omp_get_thread_num() in the team crossing the
+// barrier (by the THREAD_ID source of the build for the barriers built on
+// barriers.h, see thread_id.h). gtmp_create() may run a parallel region of num_threads (to place
+// threads or to calibrate), so call it before the team that will use it.
+// The other entry points work on a default instance set up by gtmp_init().
+// Set GTMP_VERBOSE=1 to get the configuration an instance picked (and, for
+// some barriers, statistics at gtmp_destroy()) on stdout.
+typedef struct gtmp_barrier gtmp_barrier_t;
+gtmp_barrier_t* gtmp_create(int num_threads);
+void gtmp_barrier_wait(gtmp_barrier_t* barrier);
+void gtmp_destroy(gtmp_barrier_t* barrier);
+
+// Split-phase (fuzzy) barrier, provided by the counter, tree and mcs barriers.
+// gtmp_arrive() never blocks and returns the episode to wait for. Between
+// arrive and wait a thread may do work that does not depend on the others.
+// A thread must complete gtmp_wait(), or get a non-zero gtmp_test(), before
+// it arrives again. gtmp_barrier() is gtmp_wait(gtmp_arrive()).
+typedef unsigned gtmp_token_t;
+gtmp_token_t gtmp_arrive();
+void gtmp_wait(gtmp_token_t token);
+int gtmp_test(gtmp_token_t token);
+
+// Barrier fused with an all-reduce, provided by the tree and mcs barriers.
+// Every thread passes its value and gets back the combination of the values
+// of all threads, computed on the way up the arrival tree. All threads of an
+// episode must call the same function.
+double gtmp_barrier_reduce_sum(double value);
+double gtmp_barrier_reduce_min(double value);
+double gtmp_barrier_reduce_max(double value);
+long gtmp_barrier_reduce_and(long value);
+long gtmp_barrier_reduce_or(long value);
+
 #endif
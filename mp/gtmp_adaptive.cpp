@@ -0,0 +1,35 @@
+#include <iostream>
+#include <string>
+
+#include "gtmp_api.h"
+
+template <>
+void GtmpVerbose< AdaptiveTeamBarrier<> >::created(AdaptiveTeamBarrier<> & barrier, int)
+{
+    if (barrier.get_algorithm().is_pinned())
+    {
+        std::cout << "gtmp adaptive: pinned to " + std::string(AdaptiveBarrier::get_name(barrier.get_algorithm().get_current())) + "\n";
+    }
+}
+
+template <>
+void GtmpVerbose< AdaptiveTeamBarrier<> >::destroying(AdaptiveTeamBarrier<> & barrier)
+{
+    if (barrier.get_algorithm().is_pinned())
+    {
+        return;
+    }
+
+    std::string estimates;
+    for (unsigned a = 0; a < AdaptiveBarrier::kNumAlgos; ++a)
+    {
+        const double est = barrier.get_algorithm().get_estimate(a);
+        estimates += std::string(a ? ", " : "") + AdaptiveBarrier::get_name(a) + " "
+            + (est < 0 ? std::string("n/a") : std::to_string(est) + "ns");
+    }
+
+    std::cout << "gtmp adaptive: ended on " + std::string(AdaptiveBarrier::get_name(barrier.get_algorithm().get_current()))
+        + " after " + std::to_string(barrier.get_algorithm().get_num_switches()) + " switches (" + estimates + " per episode)\n";
+}
+
+GTMP_DEFINE_BARRIER(AdaptiveTeamBarrier<>)
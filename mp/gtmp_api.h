@@ -0,0 +1,205 @@
+#ifndef INC_GTMP_API_H
+#define INC_GTMP_API_H
+
+#include "barriers.h"
+#include "aligned_new.h"
+#include "verbose.h"
+extern "C" {
+  #include "gtmp.h"
+}
+
+/*
+    The entry points of gtmp.h on top of a barrier of barriers.h. Every
+    gtmp_<name>.cpp instantiates them once for its barrier, and adds the
+    optional blocks its algorithm supports:
+
+        GTMP_DEFINE_BARRIER(CombiningTeamBarrier<>)    create, wait, destroy,
+                                                        init, barrier, finalize
+        GTMP_DEFINE_SPLIT_PHASE()                       arrive, wait, test
+        GTMP_DEFINE_REDUCE()                            barrier_reduce_*
+
+    An instance is a gtmp_barrier holding the TeamBarrier, the default one
+    is s_default. With GTMP_VERBOSE set, GtmpVerbose<TeamBarrier>::created()
+    runs at gtmp_create() and destroying() at gtmp_destroy(): specialize
+    either to print the configuration or statistics of a barrier.
+*/
+
+template <class Instance>
+struct GtmpVerbose
+{
+    static void created(Instance &, int)
+    {
+
+    }
+
+    static void destroying(Instance &)
+    {
+
+    }
+};
+
+namespace GtmpDetails
+{
+    // Split-phase crossings: the counter barriers wait on the episode alone,
+    // and the plain counter does not need to know who arrives either.
+    template <class Algo>
+    auto arrive(Algo & algo, int thread_id)
+    {
+        return algo.arrive(thread_id);
+    }
+
+    template <class WaitPolicy>
+    auto arrive(CounterBarrier<WaitPolicy> & algo, int)
+    {
+        return algo.arrive();
+    }
+
+    template <class Algo>
+    void wait(Algo & algo, int thread_id, gtmp_token_t token)
+    {
+        algo.wait(thread_id, token);
+    }
+
+    template <class WaitPolicy>
+    void wait(CounterBarrier<WaitPolicy> & algo, int, gtmp_token_t token)
+    {
+        algo.wait(token);
+    }
+
+    template <class WaitPolicy, class Layout>
+    void wait(ShardedCounterBarrier<WaitPolicy, Layout> & algo, int, gtmp_token_t token)
+    {
+        algo.wait(token);
+    }
+
+    template <class Algo>
+    bool test(Algo & algo, int thread_id, gtmp_token_t token)
+    {
+        return algo.test(thread_id, token);
+    }
+
+    template <class WaitPolicy>
+    bool test(CounterBarrier<WaitPolicy> & algo, int, gtmp_token_t token)
+    {
+        return algo.test(token);
+    }
+
+    template <class WaitPolicy, class Layout>
+    bool test(ShardedCounterBarrier<WaitPolicy, Layout> & algo, int, gtmp_token_t token)
+    {
+        return algo.test(token);
+    }
+
+    template <class Instance>
+    int get_thread_id(Instance & barrier)
+    {
+        return BarrierDetails::get_thread_id<typename Instance::Algorithm>(barrier);
+    }
+
+    template <class Instance, class T, class Op>
+    T reduce(Instance & barrier, const T & value, Op op)
+    {
+        return barrier.get_algorithm().barrier_reduce(barrier.get_thread_id(), value, op);
+    }
+}
+
+#define GTMP_DEFINE_BARRIER(...) \
+    struct alignas(LEVEL1_DCACHE_LINESIZE) gtmp_barrier \
+    { \
+        using Instance = __VA_ARGS__; \
+        \
+        explicit gtmp_barrier(int num_threads) : \
+            instance(num_threads) \
+        { \
+        \
+        } \
+        \
+        Instance instance; \
+    }; \
+    \
+    static gtmp_barrier_t * s_default = nullptr; \
+    \
+    gtmp_barrier_t * gtmp_create(int num_threads) \
+    { \
+        gtmp_barrier_t * barrier = aligned_new<gtmp_barrier_t>(num_threads); \
+        if (is_verbose()) \
+        { \
+            GtmpVerbose<gtmp_barrier_t::Instance>::created(barrier->instance, num_threads); \
+        } \
+        return barrier; \
+    } \
+    \
+    void gtmp_barrier_wait(gtmp_barrier_t * barrier) \
+    { \
+        barrier->instance.barrier(); \
+    } \
+    \
+    void gtmp_destroy(gtmp_barrier_t * barrier) \
+    { \
+        if (barrier && is_verbose()) \
+        { \
+            GtmpVerbose<gtmp_barrier_t::Instance>::destroying(barrier->instance); \
+        } \
+        aligned_delete(barrier); \
+    } \
+    \
+    void gtmp_init(int num_threads) \
+    { \
+        gtmp_destroy(s_default); \
+        s_default = gtmp_create(num_threads); \
+    } \
+    \
+    void gtmp_barrier() \
+    { \
+        gtmp_barrier_wait(s_default); \
+    } \
+    \
+    void gtmp_finalize() \
+    { \
+        gtmp_destroy(s_default); \
+        s_default = nullptr; \
+    }
+
+#define GTMP_DEFINE_SPLIT_PHASE() \
+    gtmp_token_t gtmp_arrive() \
+    { \
+        return GtmpDetails::arrive(s_default->instance.get_algorithm(), GtmpDetails::get_thread_id(s_default->instance)); \
+    } \
+    \
+    void gtmp_wait(gtmp_token_t token) \
+    { \
+        GtmpDetails::wait(s_default->instance.get_algorithm(), GtmpDetails::get_thread_id(s_default->instance), token); \
+    } \
+    \
+    int gtmp_test(gtmp_token_t token) \
+    { \
+        return GtmpDetails::test(s_default->instance.get_algorithm(), GtmpDetails::get_thread_id(s_default->instance), token); \
+    }
+
+#define GTMP_DEFINE_REDUCE() \
+    double gtmp_barrier_reduce_sum(double value) \
+    { \
+        return GtmpDetails::reduce(s_default->instance, value, SumOp()); \
+    } \
+    \
+    double gtmp_barrier_reduce_min(double value) \
+    { \
+        return GtmpDetails::reduce(s_default->instance, value, MinOp()); \
+    } \
+    \
+    double gtmp_barrier_reduce_max(double value) \
+    { \
+        return GtmpDetails::reduce(s_default->instance, value, MaxOp()); \
+    } \
+    \
+    long gtmp_barrier_reduce_and(long value) \
+    { \
+        return GtmpDetails::reduce(s_default->instance, value, AndOp()); \
+    } \
+    \
+    long gtmp_barrier_reduce_or(long value) \
+    { \
+        return GtmpDetails::reduce(s_default->instance, value, OrOp()); \
+    }
+
+#endif
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gtmp_api.h"
+
+template <>
+void GtmpVerbose< DynamicTeamBarrier<> >::destroying(DynamicTeamBarrier<> & barrier)
+{
+    const DynamicTree & tree = barrier.get_algorithm();
+
+    if (tree.get_num_samples() == 0)
+    {
+        return;
+    }
+
+    std::cout << "gtmp dynamic: " + std::to_string(tree.get_num_reorgs()) + " reorganizations, "
+        + std::to_string(tree.get_num_migrations()) + " migrations over "
+        + std::to_string(tree.get_num_samples()) + " sampled episodes\n";
+
+    // The latest threads on average, i.e. those that belong at the root and just below.
+    std::vector<int> threads(static_cast<size_t>(tree.get_num_threads()));
+    for (size_t t = 0; t < threads.size(); ++t)
+    {
+        threads[t] = static_cast<int>(t);
+    }
+    std::stable_sort(threads.begin(), threads.end(), [&tree](int a, int b)
+    {
+        return tree.get_arrival_stats(a).mean_rank > tree.get_arrival_stats(b).mean_rank;
+    });
+    threads.resize(std::min<size_t>(threads.size(), 5));
+
+    for (int t : threads)
+    {
+        const DynamicTree::ArrivalStats stats = tree.get_arrival_stats(t);
+        std::cout << "  thread " + std::to_string(t) + ": mean arrival rank " + std::to_string(stats.mean_rank)
+            + ", last " + std::to_string(100 * stats.last_fraction) + "% of episodes, now at slot "
+            + std::to_string(stats.slot) + " (level " + std::to_string(stats.level) + ")\n";
+    }
+}
+
+GTMP_DEFINE_BARRIER(DynamicTeamBarrier<>)
@@ -0,0 +1,5 @@
+#include "gtmp_api.h"
+
+// The topology-aware hierarchical barrier of hierarchical_barrier.h.
+
+GTMP_DEFINE_BARRIER(HierarchicalTeamBarrier<>)
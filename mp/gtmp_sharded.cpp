@@ -0,0 +1,14 @@
+#include <iostream>
+#include <string>
+
+#include "gtmp_api.h"
+
+template <>
+void GtmpVerbose< ShardedTeamBarrier<> >::created(ShardedTeamBarrier<> & barrier, int num_threads)
+{
+    std::cout << "gtmp sharded: " + std::to_string(barrier.get_algorithm().get_num_stripes())
+        + " stripes over " + std::to_string(num_threads) + " threads\n";
+}
+
+GTMP_DEFINE_BARRIER(ShardedTeamBarrier<>)
+GTMP_DEFINE_SPLIT_PHASE()
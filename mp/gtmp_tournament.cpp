@@ -0,0 +1,3 @@
+#include "gtmp_api.h"
+
+GTMP_DEFINE_BARRIER(TournamentTeamBarrier<>)
@@ -0,0 +1,466 @@
+#ifndef INC_HIERARCHICAL_BARRIER_H
+#define INC_HIERARCHICAL_BARRIER_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <boost/assert.hpp>
+#include <boost/align/aligned_allocator.hpp>
+
+#include "wait_policy.h"
+#include "node_arena.h"
+#include "counter_barrier.h"
+#include "mcs_tree.h"
+#include "cpu_topology.h"
+#include "verbose.h"
+
+/*
+    A topology-aware hierarchical barrier.
+
+    init() locates every thread of the team on a CPU, reads the CPU
+    topology from sysfs and groups the threads level by level:
+
+        core     threads on SMT siblings of one core (or on the same CPU)
+        node     cores of one NUMA node within a package
+        package  NUMA nodes of one package
+        system   all packages
+
+    Levels whose groups all have a single member are skipped. Every group
+    runs its own small barrier, and the one thread that completes a group
+    (the last arriver for a counter, the root for an MCS tree) carries the
+    group into the next level up before releasing it. So exactly one thread
+    per group crosses into the next level, and only the top level talks
+    across the socket interconnect.
+
+    Environment:
+        GTMP_HIER_ALGOS  algorithm per level, in the order core,node,package,system.
+                         Each one is "counter" or "mcs". Default counter,counter,counter,mcs
+        GTMP_PIN         1 pins the threads that are not bound to one CPU yet, compactly
+                         (SMT siblings first). Off by default: the pinning is
+                         permanent, every later parallel region inherits it, and it
+                         assumes the runtime hands the same OS threads to later teams
+                         of the same size, as libgomp does.
+
+    The grouping follows where the threads are when the barrier is created,
+    so it is only right for the life of the barrier if the threads are bound
+    to a CPU each, e.g. with OMP_PROC_BIND=close OMP_PLACES=threads (or
+    cores, if each thread is to get a core). Unbound threads are grouped by
+    the CPU they happened to run on, and GTMP_VERBOSE=1 reports how many
+    there were. Without OpenMP there is no team to locate: threads are
+    taken to run compactly on the allowed CPUs, and all count as unbound.
+*/
+
+enum class LevelAlgo
+{
+    Counter,
+    Mcs
+};
+
+
+// The barrier among the members of one group at one level.
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class alignas(LEVEL1_DCACHE_LINESIZE) GenericGroupBarrier
+{
+public:
+
+    // Member m runs on the same NUMA node as team thread member_threads[m],
+    // which is where its MCS node gets placed.
+    GenericGroupBarrier(LevelAlgo algo, const std::vector<int> & member_threads, int team_size) :
+        m_algo(algo),
+        m_counter(static_cast<int>(member_threads.size()))
+    {
+        if (m_algo == LevelAlgo::Mcs)
+        {
+            m_mcs.init(static_cast<int>(member_threads.size()), team_size,
+                [&member_threads](unsigned m) { return member_threads[m]; });
+        }
+    }
+
+    GenericGroupBarrier(const GenericGroupBarrier &) = delete;
+    GenericGroupBarrier & operator=(const GenericGroupBarrier &) = delete;
+
+    // upper_hook() is run by exactly one member, after every member arrived
+    // and before any is released.
+    template <class UpperHook>
+    void barrier(int member, UpperHook && upper_hook)
+    {
+        if (m_algo == LevelAlgo::Counter)
+        {
+            m_counter.barrier(upper_hook);
+        }
+        else
+        {
+            m_mcs.barrier(member, upper_hook);
+        }
+    }
+
+private:
+    LevelAlgo m_algo;
+    CounterBarrier<WaitPolicy> m_counter;
+    GenericMcsTree<4, 2, WaitPolicy, Layout> m_mcs;
+};
+
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class GenericHierarchicalBarrier
+{
+    using GroupBarrier = GenericGroupBarrier<WaitPolicy, Layout>;
+
+public:
+
+    static constexpr unsigned kNumLevelKinds = 4;
+
+    // Must be called outside of any parallel region, it runs one to locate the threads.
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        m_levels.clear();
+        m_plans.clear();
+        m_plans.resize(static_cast<size_t>(num_threads));
+
+        int num_unbound = 0;
+        const std::vector<CpuInfo> thread_cpus = place_threads(num_threads, num_unbound);
+        const std::vector<LevelAlgo> algos = read_level_algos();
+
+        // Units are what gets grouped at the current level: single threads at
+        // the bottom, then the groups formed by the previous level.
+        std::vector<Unit> units;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            units.push_back(Unit{ thread_cpus[static_cast<size_t>(t)], { t } });
+        }
+
+        for (unsigned kind = 0; kind < kNumLevelKinds && units.size() > 1; ++kind)
+        {
+            std::map<LevelKey, std::vector<size_t>> grouping;
+            for (size_t u = 0; u < units.size(); ++u)
+            {
+                grouping[get_level_key(kind, units[u].cpu)].push_back(u);
+            }
+
+            if (grouping.size() == units.size())
+            {
+                // Nothing to synchronize at this level.
+                continue;
+            }
+
+            m_levels.emplace_back();
+            Level & level = m_levels.back();
+            level.kind = kind;
+            level.algo = algos[kind];
+
+            const unsigned ilevel = static_cast<unsigned>(m_levels.size() - 1);
+            std::vector<Unit> upper_units;
+
+            for (const auto & entry : grouping)
+            {
+                const std::vector<size_t> & members = entry.second;
+                const int num_members = static_cast<int>(members.size());
+
+                GroupBarrier * group = nullptr;
+                if (num_members > 1)
+                {
+                    std::vector<int> member_threads;
+                    for (size_t u : members)
+                    {
+                        member_threads.push_back(units[u].threads.front());
+                    }
+
+                    level.groups.emplace_back(level.algo, member_threads, num_threads);
+                    group = &level.groups.back();
+                }
+
+                level.member_packages.emplace_back();
+
+                Unit upper{ units[members.front()].cpu, {} };
+                for (int m = 0; m < num_members; ++m)
+                {
+                    const Unit & unit = units[members[static_cast<size_t>(m)]];
+                    for (int t : unit.threads)
+                    {
+                        Slot & slot = m_plans[static_cast<size_t>(t)].slots[ilevel];
+                        slot.group = group;
+                        slot.member = m;
+                        upper.threads.push_back(t);
+                    }
+                    level.member_packages.back().push_back(unit.cpu.package);
+                }
+
+                upper_units.push_back(std::move(upper));
+            }
+
+            units = std::move(upper_units);
+        }
+
+        for (ThreadPlan & plan : m_plans)
+        {
+            plan.num_levels = static_cast<unsigned>(m_levels.size());
+        }
+
+        report(thread_cpus, num_unbound);
+    }
+
+    void barrier(int thread_id)
+    {
+        BOOST_ASSERT(thread_id >= 0);
+        BOOST_ASSERT(static_cast<size_t>(thread_id) < m_plans.size());
+
+        climb(m_plans[static_cast<size_t>(thread_id)], 0);
+    }
+
+private:
+
+    using LevelKey = std::tuple<int, int, int>;
+
+    struct Unit
+    {
+        CpuInfo cpu;
+        std::vector<int> threads;
+    };
+
+    struct Slot
+    {
+        GroupBarrier * group = nullptr;  // nullptr if this thread's group has one member
+        int member = 0;
+    };
+
+    // Per thread, the group it joins at each level. Read-only after init.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) ThreadPlan
+    {
+        Slot slots[kNumLevelKinds];
+        unsigned num_levels = 0;
+    };
+
+    using GroupDeque = std::deque< GroupBarrier, boost::alignment::aligned_allocator<GroupBarrier, LEVEL1_DCACHE_LINESIZE> >;
+
+    struct Level
+    {
+        unsigned kind = 0;
+        LevelAlgo algo = LevelAlgo::Counter;
+        GroupDeque groups;
+        std::vector< std::vector<int> > member_packages;  // For the report only
+    };
+
+    static const char * get_level_name(unsigned kind)
+    {
+        static const char * names[kNumLevelKinds] = { "core", "node", "package", "system" };
+        return names[kind];
+    }
+
+    static LevelKey get_level_key(unsigned kind, const CpuInfo & cpu)
+    {
+        switch (kind)
+        {
+        case 0: return LevelKey(cpu.package, cpu.node, cpu.core);
+        case 1: return LevelKey(cpu.package, cpu.node, -1);
+        case 2: return LevelKey(cpu.package, -1, -1);
+        default: return LevelKey(-1, -1, -1);
+        }
+    }
+
+    void climb(const ThreadPlan & plan, unsigned ilevel)
+    {
+        if (ilevel == plan.num_levels)
+        {
+            return;
+        }
+
+        const Slot & slot = plan.slots[ilevel];
+
+        if (!slot.group)
+        {
+            climb(plan, ilevel + 1);
+            return;
+        }
+
+        slot.group->barrier(slot.member, [this, &plan, ilevel] { climb(plan, ilevel + 1); });
+    }
+
+    static std::vector<LevelAlgo> read_level_algos()
+    {
+        std::vector<LevelAlgo> algos = { LevelAlgo::Counter, LevelAlgo::Counter, LevelAlgo::Counter, LevelAlgo::Mcs };
+
+        const char * env = std::getenv("GTMP_HIER_ALGOS");
+        if (!env)
+        {
+            return algos;
+        }
+
+        std::istringstream iss(env);
+        std::string name;
+        for (unsigned kind = 0; kind < kNumLevelKinds && std::getline(iss, name, ','); ++kind)
+        {
+            if (name == "counter")
+            {
+                algos[kind] = LevelAlgo::Counter;
+            }
+            else if (name == "mcs")
+            {
+                algos[kind] = LevelAlgo::Mcs;
+            }
+            else
+            {
+                std::cerr << "gtmp: ignoring unknown level algorithm \"" + name + "\" in GTMP_HIER_ALGOS\n";
+            }
+        }
+
+        return algos;
+    }
+
+    // Finds the CPU of every team thread: the one it is bound to, or else the
+    // one it runs on now, unless GTMP_PIN=1 pins it. Counts the threads that
+    // are left unbound.
+    static std::vector<CpuInfo> place_threads(int num_threads, int & num_unbound)
+    {
+        const std::vector<CpuInfo> allowed = read_allowed_cpus();
+        const char * env_pin = std::getenv("GTMP_PIN");
+        const bool pin = env_pin && std::string(env_pin) == "1";
+
+        std::vector<int> thread_cpu(static_cast<size_t>(num_threads), 0);
+        int unbound = 0;
+
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(num_threads) reduction(+: unbound)
+        {
+            const int t = omp_get_thread_num();
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+
+            int cpu = sched_getcpu();
+
+            if (CPU_COUNT(&set) == 1)
+            {
+                for (int c = 0; c < CPU_SETSIZE; ++c)
+                {
+                    if (CPU_ISSET(c, &set))
+                    {
+                        cpu = c;
+                    }
+                }
+            }
+            else if (pin)
+            {
+                cpu = allowed[static_cast<size_t>(t) % allowed.size()].cpu;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+            else
+            {
+                ++unbound;
+            }
+
+            thread_cpu[static_cast<size_t>(t)] = cpu;
+        }
+#else
+        (void)pin;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            thread_cpu[static_cast<size_t>(t)] = allowed[static_cast<size_t>(t) % allowed.size()].cpu;
+        }
+        unbound = num_threads;
+#endif
+
+        num_unbound = unbound;
+
+        std::vector<CpuInfo> thread_cpus;
+        for (int cpu : thread_cpu)
+        {
+            thread_cpus.push_back(read_cpu_info(cpu));
+        }
+        return thread_cpus;
+    }
+
+    // Rough count of cache lines crossing the socket interconnect per barrier
+    // crossing, for a group whose members live on the given packages.
+    // Counter: every member away from the first member's package pulls the
+    // count line once and the sense line once. MCS: one line per arrival
+    // edge (4-ary) and per wakeup edge (2-ary) that joins two packages.
+    static unsigned estimate_cross_package_transfers(LevelAlgo algo, const std::vector<int> & packages)
+    {
+        unsigned transfers = 0;
+        const size_t n = packages.size();
+
+        if (algo == LevelAlgo::Counter)
+        {
+            for (size_t i = 1; i < n; ++i)
+            {
+                transfers += (packages[i] != packages[0]) ? 2 : 0;
+            }
+            return transfers;
+        }
+
+        for (size_t i = 1; i < n; ++i)
+        {
+            transfers += (packages[i] != packages[(i - 1) / 4]) ? 1 : 0;
+            transfers += (packages[i] != packages[(i - 1) / 2]) ? 1 : 0;
+        }
+        return transfers;
+    }
+
+    void report(const std::vector<CpuInfo> & thread_cpus, int num_unbound) const
+    {
+        std::vector<int> thread_packages;
+        for (const CpuInfo & cpu : thread_cpus)
+        {
+            thread_packages.push_back(cpu.package);
+        }
+
+        std::ostringstream oss;
+        oss << "gtmp: hierarchical barrier over " << thread_cpus.size() << " threads\n";
+        if (num_unbound > 0)
+        {
+            oss << "gtmp:   " << num_unbound << " thread(s) not bound to a CPU, grouped by where they ran"
+                << " (set OMP_PROC_BIND and OMP_PLACES, or GTMP_PIN=1)\n";
+        }
+
+        unsigned hier_transfers = 0;
+        for (const Level & level : m_levels)
+        {
+            size_t largest = 0;
+            for (const auto & packages : level.member_packages)
+            {
+                largest = std::max(largest, packages.size());
+                hier_transfers += estimate_cross_package_transfers(level.algo, packages);
+            }
+
+            oss << "gtmp:   level " << get_level_name(level.kind)
+                << ": " << (level.algo == LevelAlgo::Counter ? "counter" : "mcs")
+                << ", " << level.member_packages.size() << " group(s), largest has "
+                << largest << " member(s)\n";
+        }
+
+        const unsigned flat_counter = estimate_cross_package_transfers(LevelAlgo::Counter, thread_packages);
+        const unsigned flat_mcs = estimate_cross_package_transfers(LevelAlgo::Mcs, thread_packages);
+
+        oss << "gtmp: estimated cross-socket cache line transfers per crossing: flat counter "
+            << flat_counter << ", flat mcs " << flat_mcs << ", hierarchical " << hier_transfers
+            << " (saves " << (flat_mcs > hier_transfers ? flat_mcs - hier_transfers : 0) << " vs flat mcs)\n";
+
+        print_verbose(oss.str());
+    }
+
+    std::deque<Level> m_levels;  // Groups are referenced by address, so never relocate them
+    std::vector< ThreadPlan, boost::alignment::aligned_allocator<ThreadPlan, LEVEL1_DCACHE_LINESIZE> > m_plans;
+};
+
+using HierarchicalBarrier = GenericHierarchicalBarrier<>;
+
+#endif
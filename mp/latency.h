@@ -0,0 +1,280 @@
+#ifndef INC_LATENCY_H
+#define INC_LATENCY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/align/aligned_allocator.hpp>
+
+#include "perf_counters.h"
+#include "tsc_clock.h"
+
+// Per-crossing timing of barriers, timestamped with TscClock (tsc_clock.h).
+
+struct Percentiles
+{
+	double p50 = 0;
+	double p90 = 0;
+	double p99 = 0;
+	double p999 = 0;
+	double max = 0;
+
+	// Nearest rank percentiles of values, in ns. Reorders values.
+	static Percentiles from_ticks(std::vector<uint64_t> & values)
+	{
+		Percentiles res;
+		if (values.empty())
+		{
+			return res;
+		}
+
+		std::sort(values.begin(), values.end());
+
+		auto at = [&values](double q)
+		{
+			const size_t rank = static_cast<size_t>(q * double(values.size() - 1) + 0.5);
+			return TscClock::to_ns(values[rank]);
+		};
+
+		res.p50 = at(0.5);
+		res.p90 = at(0.9);
+		res.p99 = at(0.99);
+		res.p999 = at(0.999);
+		res.max = TscClock::to_ns(values.back());
+		return res;
+	}
+};
+
+struct LatencyReport
+{
+	std::string name;           // Barrier algorithm
+	int num_threads = 0;
+	unsigned num_iters = 0;
+	unsigned num_sampled = 0;   // Crossings timed
+	double crossings_per_second = 0;
+
+	Percentiles wait;           // Per thread, own arrival to own release
+	Percentiles release;        // Per thread, last arrival of the team to own release
+	Percentiles arrival_skew;   // Per crossing, first to last arrival
+	Percentiles release_skew;   // Per crossing, first to last release
+
+	PerfCounts perf;            // Of the timed loop, with --perf
+
+	void write_text(std::ostream & os) const;
+	void write_csv(std::ostream & os, bool with_header) const;
+	void write_json(std::ostream & os) const;
+};
+
+
+// Fixed size per thread buffers of (arrival, release) timestamps, filled in
+// during the timed loop with no allocation and no sharing: crossing iter is
+// recorded if is_sampled(iter), in slot iter / sample interval.
+//
+// The sample interval is a power of 2, so that the untimed crossings only
+// pay for a mask test.
+class LatencyRecorder
+{
+public:
+
+	LatencyRecorder(int num_threads, unsigned num_iters, unsigned sample_interval)
+	{
+		BOOST_ASSERT(num_threads > 0);
+
+		// Rounded up to a power of 2, at most 2^31 so that the shift stays in range.
+		sample_interval = std::min(sample_interval, 1u << 31);
+		m_shift = sample_interval <= 1 ? 0 : 32 - static_cast<unsigned>(__builtin_clz(sample_interval - 1));
+		m_mask = (1u << m_shift) - 1;
+		m_num_sampled = num_iters == 0 ? 0 : ((num_iters - 1) >> m_shift) + 1;
+
+		m_threads.resize(static_cast<size_t>(num_threads));
+		for (ThreadSamples & samples : m_threads)
+		{
+			samples.arrive.assign(m_num_sampled, 0);
+			samples.release.assign(m_num_sampled, 0);
+		}
+	}
+
+	bool is_sampled(unsigned iter) const
+	{
+		return (iter & m_mask) == 0;
+	}
+
+	void record(int thread_id, unsigned iter, uint64_t arrive, uint64_t release)
+	{
+		ThreadSamples & samples = m_threads[static_cast<size_t>(thread_id)];
+		const unsigned slot = iter >> m_shift;
+
+		BOOST_ASSERT(slot < m_num_sampled);
+		samples.arrive[slot] = arrive;
+		samples.release[slot] = release;
+	}
+
+	unsigned get_sample_interval() const
+	{
+		return 1u << m_shift;
+	}
+
+	// Fills the distributions of report from the recorded samples.
+	void summarize(LatencyReport & report) const
+	{
+		std::vector<uint64_t> wait;
+		std::vector<uint64_t> release;
+		std::vector<uint64_t> arrival_skew;
+		std::vector<uint64_t> release_skew;
+
+		for (unsigned s = 0; s < m_num_sampled; ++s)
+		{
+			uint64_t first_arrive = std::numeric_limits<uint64_t>::max();
+			uint64_t last_arrive = 0;
+			uint64_t first_release = std::numeric_limits<uint64_t>::max();
+			uint64_t last_release = 0;
+
+			for (const ThreadSamples & samples : m_threads)
+			{
+				first_arrive = std::min(first_arrive, samples.arrive[s]);
+				last_arrive = std::max(last_arrive, samples.arrive[s]);
+				first_release = std::min(first_release, samples.release[s]);
+				last_release = std::max(last_release, samples.release[s]);
+
+				wait.push_back(samples.release[s] - samples.arrive[s]);
+			}
+
+			// Releases read on another core can come out slightly before the
+			// last arrival, clamp instead of wrapping around.
+			for (const ThreadSamples & samples : m_threads)
+			{
+				release.push_back(samples.release[s] > last_arrive ? samples.release[s] - last_arrive : 0);
+			}
+
+			arrival_skew.push_back(last_arrive - first_arrive);
+			release_skew.push_back(last_release - first_release);
+		}
+
+		report.num_sampled = m_num_sampled;
+		report.wait = Percentiles::from_ticks(wait);
+		report.release = Percentiles::from_ticks(release);
+		report.arrival_skew = Percentiles::from_ticks(arrival_skew);
+		report.release_skew = Percentiles::from_ticks(release_skew);
+	}
+
+private:
+
+	using TickVec = std::vector< uint64_t, boost::alignment::aligned_allocator<uint64_t, LEVEL1_DCACHE_LINESIZE> >;
+
+	struct alignas(LEVEL1_DCACHE_LINESIZE) ThreadSamples
+	{
+		TickVec arrive;
+		TickVec release;
+	};
+
+	std::vector< ThreadSamples, boost::alignment::aligned_allocator<ThreadSamples, LEVEL1_DCACHE_LINESIZE> > m_threads;
+	unsigned m_shift = 0;
+	unsigned m_mask = 0;
+	unsigned m_num_sampled = 0;
+};
+
+
+namespace LatencyDetails
+{
+	struct NamedPercentiles
+	{
+		const char * name;
+		const Percentiles * values;
+	};
+
+	inline std::vector<NamedPercentiles> get_distributions(const LatencyReport & report)
+	{
+		return {
+			{ "wait", &report.wait },
+			{ "release", &report.release },
+			{ "arrival_skew", &report.arrival_skew },
+			{ "release_skew", &report.release_skew }
+		};
+	}
+
+	inline std::string format_ns(double ns)
+	{
+		std::ostringstream oss;
+		oss << std::fixed << std::setprecision(1) << ns;
+		return oss.str();
+	}
+}
+
+inline void LatencyReport::write_text(std::ostream & os) const
+{
+	using namespace LatencyDetails;
+
+	os << name + ", " + std::to_string(num_threads) + " threads, " + std::to_string(num_sampled) + " of "
+		+ std::to_string(num_iters) + " crossings timed, " + std::to_string(crossings_per_second) + " crossings/s\n";
+
+	os << "  ns            p50       p90       p99     p99.9       max\n";
+	for (const NamedPercentiles & dist : get_distributions(*this))
+	{
+		os << "  " << std::left << std::setw(12) << dist.name << std::right;
+		for (double val : { dist.values->p50, dist.values->p90, dist.values->p99, dist.values->p999, dist.values->max })
+		{
+			os << std::setw(10) << format_ns(val);
+		}
+		os << "\n";
+	}
+
+	perf.write_text(os);
+}
+
+inline void LatencyReport::write_csv(std::ostream & os, bool with_header) const
+{
+	using namespace LatencyDetails;
+
+	const char * suffixes[] = { "p50", "p90", "p99", "p999", "max" };
+
+	if (with_header)
+	{
+		os << "algorithm,threads,iters,sampled,crossings_per_second";
+		for (const NamedPercentiles & dist : get_distributions(*this))
+		{
+			for (const char * suffix : suffixes)
+			{
+				os << "," << dist.name << "_" << suffix << "_ns";
+			}
+		}
+		PerfCounts::write_csv_header(os);
+		os << "\n";
+	}
+
+	os << name << "," << num_threads << "," << num_iters << "," << num_sampled << "," << std::to_string(crossings_per_second);
+	for (const NamedPercentiles & dist : get_distributions(*this))
+	{
+		for (double val : { dist.values->p50, dist.values->p90, dist.values->p99, dist.values->p999, dist.values->max })
+		{
+			os << "," << format_ns(val);
+		}
+	}
+	perf.write_csv(os);
+	os << "\n";
+}
+
+inline void LatencyReport::write_json(std::ostream & os) const
+{
+	using namespace LatencyDetails;
+
+	os << "{\"algorithm\": \"" << name << "\", \"threads\": " << num_threads << ", \"iters\": " << num_iters
+		<< ", \"sampled\": " << num_sampled << ", \"crossings_per_second\": " << std::to_string(crossings_per_second);
+
+	for (const NamedPercentiles & dist : get_distributions(*this))
+	{
+		const Percentiles & p = *dist.values;
+		os << ", \"" << dist.name << "_ns\": {\"p50\": " << format_ns(p.p50) << ", \"p90\": " << format_ns(p.p90)
+			<< ", \"p99\": " << format_ns(p.p99) << ", \"p99.9\": " << format_ns(p.p999) << ", \"max\": " << format_ns(p.max) << "}";
+	}
+	perf.write_json(os);
+	os << "}\n";
+}
+
+#endif
@@ -1,28 +1,121 @@
 
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <thread>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
 #include <boost/numeric/conversion/cast.hpp>
 #include <boost/assert.hpp>
+#include <boost/align/aligned_allocator.hpp>
 
 #include <omp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "profiler.h"
+#include "latency.h"
+#include "workload.h"
+#include "perf_counters.h"
+#include "barriers.h"
+#include "aligned_new.h"
+#include "shm_segment.h"
+#include "shm_barriers.h"
+#include "task_pool.h"
 
 extern "C" {
   #include "gtmp.h"
 }
 
+// Optional entry points, not every algorithm provides them.
+#pragma weak gtmp_arrive
+#pragma weak gtmp_wait
+#pragma weak gtmp_test
+#pragma weak gtmp_barrier_reduce_sum
+
+enum class Team
+{
+	Fork,       // A parallel region per crossing, as in GTMP_Data.csv
+	Persistent  // One parallel region for the whole loop
+};
+
 class ArgParse
 {
 public:
+	// Usage: <exe> [num_threads] [--iters N] [--mode barrier|split|reduce|nested|sibling|latency|omp|load|inline|litmus|complete|process|tasks] [--work N]
+	//             [--sample N] [--format text|csv|json] [--out FILE] [--team fork|persistent]
+	//             [--load SPEC] [--seed N] [--perf 0|1]
+	//
+	//   barrier  time gtmp_barrier() crossings (default)
+	//   split    time gtmp_barrier() then N units of private work, against
+	//            gtmp_arrive(), the same work, then gtmp_wait()
+	//   reduce   time an all-reduce done with omp atomic and gtmp_barrier(),
+	//            against gtmp_barrier_reduce_sum()
+	//   nested   two teams of num_threads/2, each crossing its own
+	//            gtmp_create() instance at the same time
+	//   sibling  throughput of a compute thread outside the team, alone
+	//            and while the team crosses barriers (place it on an SMT
+	//            sibling with taskset / GOMP_CPU_AFFINITY)
+	//   latency  per crossing timing of gtmp_barrier() after the workload:
+	//            percentiles of the wait and release latency and of the
+	//            arrival and release skew. Every Nth crossing is timed with
+	//            --sample (rounded up to a power of 2, default: enough to
+	//            keep 2^18 samples per thread at most). The report is
+	//            written to --out (appended, CSV header if the file is new)
+	//            or stdout.
+	//   omp      gtmp_barrier() against #pragma omp barrier, and the two
+	//            alternating, all in a persistent team
+	//   load     phases of the workload separated by gtmp_barrier(), total
+	//            time against an ideal barrier
+	//   inline   gtmp_barrier() against the same algorithm from barriers.h,
+	//            inlined into the loop, all in a persistent team
+	//   litmus   message passing through gtmp_barrier() under random delays
+	//            drawn from the workload (e.g. --load uniform:0:200), fails
+	//            if a write before a crossing is not seen after it
+	//   complete barrier, omp single, barrier against one barrier_complete()
+	//            of the header-only twin (counter, tree and mcs), for a
+	//            phase change done by one thread and seen by all, with a
+	//            completion step that returns the phase and one that does not
+	//   process  num_threads forked processes crossing the process-shared
+	//            twin (shm_barriers.h: counter, tree and mcs) in a shm_open
+	//            segment, against a PTHREAD_PROCESS_SHARED pthread_barrier_t
+	//   tasks    phases of the workload separated by the header-only twin,
+	//            with low priority tasks of --work units per slice (default
+	//            256) queued up front: run after the phases, against run by
+	//            the threads waiting at the barrier (TaskWait, task_pool.h)
+	//
+	// The workload is --load SPEC (see workload.h), fixed:N with --work N
+	// otherwise. --seed changes its random draws.
+	//
+	// --perf 1 counts hardware events of every timed loop on each thread
+	// (see perf_counters.h) and prints them per thread and crossing, also
+	// in the latency and load reports.
+	//
+	// --team persistent runs the timed loops of all modes but nested in a
+	// single parallel region, so that they time the barrier rather than
+	// libgomp's fork/join.
 	ArgParse(int argc, char ** argv)
 	{
-		if (argc >= 2)
+		int iarg = 1;
+
+		m_program = argv[0];
+		const size_t slash = m_program.find_last_of('/');
+		if (slash != std::string::npos)
+		{
+			m_program = m_program.substr(slash + 1);
+		}
+
+		if (iarg < argc && argv[iarg][0] != '-')
 		{
-			std::string str(argv[1]);
+			std::string str(argv[iarg++]);
 			m_num_threads = std::stoi(str);
 			BOOST_ASSERT(m_num_threads >= 1);
 		}
@@ -31,7 +124,78 @@ public:
 			m_num_threads = std::thread::hardware_concurrency();
 		}
 
+		for (; iarg < argc; iarg += 2)
+		{
+			const std::string key(argv[iarg]);
+
+			if (iarg + 1 >= argc)
+			{
+				std::cerr << "Missing value for option " + key + "\n";
+				std::exit(1);
+			}
+
+			const std::string val(argv[iarg + 1]);
+
+			if (key == "--iters")
+			{
+				m_num_iters = boost::numeric_cast<unsigned>(std::stoul(val));
+			}
+			else if (key == "--mode")
+			{
+				m_mode = val;
+			}
+			else if (key == "--work")
+			{
+				m_work = boost::numeric_cast<unsigned>(std::stoul(val));
+			}
+			else if (key == "--sample")
+			{
+				m_sample_interval = boost::numeric_cast<unsigned>(std::stoul(val));
+			}
+			else if (key == "--format")
+			{
+				if (val != "text" && val != "csv" && val != "json")
+				{
+					std::cerr << "Unknown format " + val + ", expected text, csv or json\n";
+					std::exit(1);
+				}
+				m_format = val;
+			}
+			else if (key == "--out")
+			{
+				m_out = val;
+			}
+			else if (key == "--load")
+			{
+				m_load = val;
+			}
+			else if (key == "--seed")
+			{
+				m_seed = std::stoull(val);
+			}
+			else if (key == "--perf")
+			{
+				m_perf = val != "0";
+			}
+			else if (key == "--team")
+			{
+				if (val != "fork" && val != "persistent")
+				{
+					std::cerr << "Unknown team " + val + ", expected fork or persistent\n";
+					std::exit(1);
+				}
+				m_team = val == "fork" ? Team::Fork : Team::Persistent;
+			}
+			else
+			{
+				std::cerr << "Unknown option " + key + "\n";
+				std::exit(1);
+			}
+		}
+
 		std::cout << "Number of threads is " + std::to_string(m_num_threads) + "\n";
+
+		m_workload = m_load.empty() ? Workload::fixed(m_work) : Workload::parse(m_load, m_seed, m_num_threads);
 	}
 
 	int get_num_threads() const
@@ -39,8 +203,73 @@ public:
 		return m_num_threads;
 	}
 
+	unsigned get_num_iters() const
+	{
+		return m_num_iters;
+	}
+
+	const std::string & get_mode() const
+	{
+		return m_mode;
+	}
+
+	unsigned get_work() const
+	{
+		return m_work;
+	}
+
+	// 0 if not given
+	unsigned get_sample_interval() const
+	{
+		return m_sample_interval;
+	}
+
+	const std::string & get_format() const
+	{
+		return m_format;
+	}
+
+	// Empty if not given
+	const std::string & get_out() const
+	{
+		return m_out;
+	}
+
+	const Workload & get_workload() const
+	{
+		return m_workload;
+	}
+
+	bool get_perf() const
+	{
+		return m_perf;
+	}
+
+	Team get_team() const
+	{
+		return m_team;
+	}
+
+	// Executable name, i.e. the barrier algorithm
+	const std::string & get_program() const
+	{
+		return m_program;
+	}
+
 private:
 	int m_num_threads = 1;
+	unsigned m_num_iters = 1 << 22;
+	std::string m_mode = "barrier";
+	unsigned m_work = 0;
+	unsigned m_sample_interval = 0;
+	std::string m_format = "text";
+	std::string m_out;
+	std::string m_program;
+	Team m_team = Team::Fork;
+	std::string m_load;
+	uint64_t m_seed = 1;
+	Workload m_workload;
+	bool m_perf = false;
 };
 
 class alignas(LEVEL1_DCACHE_LINESIZE) MyInt
@@ -78,54 +307,1153 @@ inline bool is_power_of_2(unsigned x)
 	return ((x != 0) && ((x & (~x + 1)) == x));
 }
 
-int main(int argc, char ** argv)
+// Stand-in for computation that does not depend on other threads.
+inline void do_private_work(unsigned units)
 {
-	// Get num threads
-	const ArgParse args(argc, argv);
-	const int num_threads = args.get_num_threads();
+	for (unsigned i = 0; i < units; ++i)
+	{
+		asm volatile("" ::: "memory");
+	}
+}
 
-	// Disable dynamic threading
-	omp_set_dynamic(0);
-	BOOST_ASSERT(omp_get_dynamic() == 0);
+// do_private_work() units per second on one thread, best of a few runs so
+// that a cold start or a preemption does not skew it.
+double measure_work_rate()
+{
+	const unsigned kUnits = 1 << 22;
+	const unsigned kRuns = 8;
 
-	omp_set_num_threads(num_threads);
+	double best = 0;
+	for (unsigned i = 0; i < kRuns; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		do_private_work(kUnits);
+		const auto end = std::chrono::steady_clock::now();
+
+		best = std::max(best, kUnits / std::chrono::duration<double>(end - start).count());
+	}
+	return best;
+}
 
+// Set from --perf. run_crossings() then leaves the counts of its timed loop
+// in s_last_perf.
+static bool s_count_perf = false;
+static PerfCounts s_last_perf;
 
-	gtmp_init(num_threads);
+// Calls crossing(thread_id, iter) num_iters times on every thread of the
+// team, either from a parallel section per iteration or from a single one.
+// Returns the elapsed seconds. Nothing else runs in the timed loop, the
+// barrier is checked beforehand by check_barrier().
+template <class Crossing>
+double run_crossings(const std::string & name, int num_threads, unsigned num_iters, Team team, Crossing crossing)
+{
+	TeamPerfCounters counters(num_threads);
+	if (s_count_perf)
+	{
+		counters.start();
+	}
+
+	Profiler p(name);
 
+	if (team == Team::Persistent)
 	{
-		Profiler p("Parallel Section");
-		std::vector<MyInt> workspace(num_threads);
+		#pragma omp parallel
+		{
+			const int thread_id = omp_get_thread_num();
+
+			for (unsigned i = 0; i < num_iters; ++i)
+			{
+				crossing(thread_id, i);
 
-		constexpr unsigned kMaxIters = 1 << 22;
-		for (unsigned i = 0; i < kMaxIters; ++i)
+				if (thread_id == 0 && is_power_of_2(i))
+				{
+					std::cout << "." << std::flush;
+				}
+			}
+		}
+	}
+	else
+	{
+		for (unsigned i = 0; i < num_iters; ++i)
 		{
 			#pragma omp parallel
+			{
+				crossing(omp_get_thread_num(), i);
+			} // End paralle section
+
+			if (is_power_of_2(i))
+			{
+				std::cout << "." << std::flush;
+			}
+		}
+	}
+	std::cout << std::endl;
+
+	const double seconds = p.get_elapsed_seconds();
+
+	if (s_count_perf)
+	{
+		s_last_perf = counters.stop(num_iters);
+		s_last_perf.write_text(std::cout);
+	}
+
+	return seconds;
+}
+
+// Untimed check of barrier(thread_id) with the team style of the timed loops:
+// every thread bumps its own counter before each crossing, and after it
+// finds its neighbour's counter equal to its own, or one ahead if the
+// neighbour already left for the next crossing.
+template <class Barrier>
+void check_barrier(int num_threads, unsigned num_iters, Team team, Barrier barrier)
+{
+	struct alignas(LEVEL1_DCACHE_LINESIZE) Counter
+	{
+		std::atomic<unsigned> val{ 0 };
+	};
+
+	std::vector< Counter, boost::alignment::aligned_allocator<Counter, LEVEL1_DCACHE_LINESIZE> > counters(num_threads);
+
+	// Not a timed loop
+	const bool count_perf = s_count_perf;
+	s_count_perf = false;
+
+	run_crossings("Checking the barrier", num_threads, num_iters, team, [&counters, &barrier, num_threads](int thread_id, unsigned)
+	{
+		const unsigned mine = counters[thread_id].val.fetch_add(1, std::memory_order_relaxed) + 1;
+
+		barrier(thread_id);
+
+		if (thread_id < (num_threads - 1))
+		{
+			const unsigned next = counters[thread_id + 1].val.load(std::memory_order_relaxed);
+			BOOST_ASSERT(next == mine || next == mine + 1);
+			(void)next;
+		}
+	});
+
+	s_count_perf = count_perf;
+}
+
+void check_barrier(int num_threads, unsigned num_iters, Team team)
+{
+	check_barrier(num_threads, num_iters, team, [](int)
+	{
+		gtmp_barrier();
+	});
+}
+
+// Runs a compute loop on a thread outside the team for as long as during()
+// runs, and returns the work units it got done per second.
+template <class During>
+double measure_sibling_rate(During during)
+{
+	const unsigned kUnitsPerRound = 1000;
+
+	std::atomic<bool> stop(false);
+	uint64_t rounds = 0;
+
+	std::thread sibling([&stop, &rounds]
+	{
+		while (!stop.load(std::memory_order_relaxed))
+		{
+			do_private_work(kUnitsPerRound);
+			++rounds;
+		}
+	});
+
+	const auto start = std::chrono::steady_clock::now();
+	during();
+	const auto end = std::chrono::steady_clock::now();
+
+	stop = true;
+	sibling.join();
+
+	return double(rounds) * kUnitsPerRound / std::chrono::duration<double>(end - start).count();
+}
+
+void run_sibling(const ArgParse & args)
+{
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+
+	const Team team = args.get_team();
+	double barrier_seconds = 0;
+
+	const double alone = measure_sibling_rate([]
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	});
+
+	const double shared = measure_sibling_rate([&barrier_seconds, num_threads, num_iters, team]
+	{
+		barrier_seconds = run_crossings("Barrier next to a sibling workload", num_threads, num_iters, team, [](int, unsigned)
+		{
+			gtmp_barrier();
+		});
+	});
+
+	std::cout << "Crossing: " + std::to_string(barrier_seconds * 1e9 / num_iters) + "ns, sibling: "
+		+ std::to_string(alone / 1e6) + "M units/s alone, " + std::to_string(shared / 1e6)
+		+ "M units/s next to the barrier (" + std::to_string(100 * shared / alone) + "%)\n";
+}
+
+void run_split(const ArgParse & args)
+{
+	if (!gtmp_arrive || !gtmp_wait)
+	{
+		std::cout << "This barrier does not provide gtmp_arrive/gtmp_wait\n";
+		return;
+	}
+
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+	const unsigned work = args.get_work();
+	const Team team = args.get_team();
+
+	const double blocking = run_crossings("Barrier then work", num_threads, num_iters, team, [work](int, unsigned)
+	{
+		gtmp_barrier();
+		do_private_work(work);
+	});
+
+	const double split = run_crossings("Arrive, work, wait", num_threads, num_iters, team, [work](int, unsigned)
+	{
+		const gtmp_token_t token = gtmp_arrive();
+		do_private_work(work);
+		gtmp_wait(token);
+	});
+
+	const double hidden_ns = (blocking - split) * 1e9 / num_iters;
+	std::cout << "Latency hidden per crossing: " + std::to_string(hidden_ns) + "ns ("
+		+ std::to_string(work) + " work units)\n";
+}
+
+void run_reduce(const ArgParse & args)
+{
+	if (!gtmp_barrier_reduce_sum)
+	{
+		std::cout << "This barrier does not provide gtmp_barrier_reduce_sum\n";
+		return;
+	}
+
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+	const Team team = args.get_team();
+
+	// Thread t contributes t + iter, the sum is exact in a double.
+	auto expected_sum = [num_threads](unsigned iter)
+	{
+		return double(num_threads) * iter + double(num_threads) * (num_threads - 1) / 2;
+	};
+
+	// Accumulators are rotated so that thread 0 can clear the one for the next
+	// iteration before the barrier: the last readers of that one passed two
+	// barriers ago.
+	double sums[3] = { 0, 0, 0 };
+
+	const double atomic = run_crossings("Omp atomic then barrier", num_threads, num_iters, team,
+		[&sums, expected_sum](int thread_id, unsigned iter)
+	{
+		double & sum = sums[iter % 3];
+
+		#pragma omp atomic
+		sum += thread_id + double(iter);
+
+		if (thread_id == 0)
+		{
+			sums[(iter + 1) % 3] = 0;
+		}
+
+		gtmp_barrier();
+
+		double result;
+		#pragma omp atomic read
+		result = sum;
+
+		BOOST_ASSERT(result == expected_sum(iter));
+		(void)result;
+	});
+
+	const double fused = run_crossings("Fused reduce barrier", num_threads, num_iters, team,
+		[expected_sum](int thread_id, unsigned iter)
+	{
+		const double result = gtmp_barrier_reduce_sum(thread_id + double(iter));
+
+		BOOST_ASSERT(result == expected_sum(iter));
+		(void)result;
+	});
+
+	const double saved_ns = (atomic - fused) * 1e9 / num_iters;
+	std::cout << "Saved per reduction: " + std::to_string(saved_ns) + "ns\n";
+}
+
+void run_nested(const ArgParse & args)
+{
+	const int num_inner = std::max(args.get_num_threads() / 2, 1);
+	const unsigned num_iters = args.get_num_iters();
+
+	omp_set_max_active_levels(2);
+
+	Profiler p("Two teams of " + std::to_string(num_inner) + " on their own barriers");
+
+	#pragma omp parallel num_threads(2)
+	{
+		gtmp_barrier_t * barrier = gtmp_create(num_inner);
+		std::vector<MyInt> workspace(num_inner);
+
+		for (unsigned i = 0; i < num_iters; ++i)
+		{
+			#pragma omp parallel num_threads(num_inner)
 			{
 				const int thread_id = omp_get_thread_num();
 				++(workspace[thread_id]);
 
-				gtmp_barrier();
+				gtmp_barrier_wait(barrier);
 
-				// After barrier, every thread's value should be equal to its neighbour.
-				if (thread_id < (num_threads - 1))
+				if (thread_id < (num_inner - 1))
 				{
 					BOOST_ASSERT(workspace[thread_id] == workspace[thread_id + 1]);
 				}
-			} // End paralle section
+			}
+		}
 
-			if (is_power_of_2(i))
+		gtmp_destroy(barrier);
+	}
+}
+
+void run_omp(const ArgParse & args)
+{
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+
+	const double gtmp = run_crossings("gtmp_barrier", num_threads, num_iters, Team::Persistent, [](int, unsigned)
+	{
+		gtmp_barrier();
+	});
+
+	const double omp = run_crossings("omp barrier", num_threads, num_iters, Team::Persistent, [](int, unsigned)
+	{
+		#pragma omp barrier
+	});
+
+	// Also checks that gtmp_barrier() keeps working between barriers it does not know about.
+	const double mixed = run_crossings("gtmp_barrier then omp barrier", num_threads, num_iters, Team::Persistent, [](int, unsigned)
+	{
+		gtmp_barrier();
+		#pragma omp barrier
+	});
+
+	const double gtmp_ns = gtmp * 1e9 / num_iters;
+	const double omp_ns = omp * 1e9 / num_iters;
+
+	std::cout << "gtmp_barrier: " + std::to_string(gtmp_ns) + "ns, omp barrier: " + std::to_string(omp_ns)
+		+ "ns, both in a row: " + std::to_string(mixed * 1e9 / num_iters) + "ns per crossing ("
+		+ std::to_string(gtmp_ns / omp_ns) + "x omp)\n";
+}
+
+// Message passing through the barrier. Before crossing i every thread
+// writes i to its slot of buffer i % 2 with a plain store, after it every
+// thread reads all slots of that buffer with plain loads and expects i. The
+// buffer is only written again after crossing i + 1, which every reader of
+// crossing i has to arrive at first, so the slots are race free if and only
+// if the barrier orders them (also what ThreadSanitizer checks, see SANITIZE
+// in the Makefile).
+//
+// Delays drawn from the workload before the write, between the write and
+// the arrival and after the release, and a yield whenever a delay is a
+// multiple of 16 units, shuffle the schedule so that the orderings of the
+// barrier have to carry the writes rather than timing.
+void run_litmus(const ArgParse & args)
+{
+	struct alignas(LEVEL1_DCACHE_LINESIZE) Slot
+	{
+		unsigned val[2] = { ~0u, ~0u };
+		uint64_t num_stale = 0;
+	};
+
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+	const Workload & load = args.get_workload();
+
+	std::vector< Slot, boost::alignment::aligned_allocator<Slot, LEVEL1_DCACHE_LINESIZE> > slots(num_threads);
+
+	auto delay = [&load](int thread_id, unsigned iter, unsigned point)
+	{
+		const unsigned units = load.get_units(thread_id, 3 * iter + point);
+		do_private_work(units);
+		if (units % 16 == 0)
+		{
+			std::this_thread::yield();
+		}
+	};
+
+	run_crossings("Litmus", num_threads, num_iters, args.get_team(), [&slots, &delay, num_threads](int thread_id, unsigned i)
+	{
+		Slot & mine = slots[thread_id];
+
+		delay(thread_id, i, 0);
+		mine.val[i % 2] = i;
+		delay(thread_id, i, 1);
+
+		gtmp_barrier();
+
+		delay(thread_id, i, 2);
+		for (int t = 0; t < num_threads; ++t)
+		{
+			if (slots[t].val[i % 2] != i)
 			{
-				std::cout << "." << std::flush;
+				++mine.num_stale;
 			}
 		}
-		std::cout << std::endl;
-	}
+	});
 
+	uint64_t num_stale = 0;
+	for (const Slot & slot : slots)
+	{
+		num_stale += slot.num_stale;
+	}
 
-	gtmp_finalize();
+	std::cout << "litmus under " + load.get_spec() + ": " + std::to_string(num_stale) + " stale reads out of "
+		+ std::to_string(uint64_t(num_iters) * unsigned(num_threads) * unsigned(num_threads)) + "\n";
 
-	return 0;
+	if (num_stale != 0)
+	{
+		std::exit(1);
+	}
 }
 
+// Barrier is the header-only twin of the algorithm of this executable.
+template <class Barrier>
+void run_inline(const ArgParse & args)
+{
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+
+	// Created outside of the team, see barriers.h
+	Barrier * barrier = aligned_new<Barrier>(num_threads);
+
+	check_barrier(num_threads, std::min(num_iters, 1000u), Team::Persistent, [barrier](int thread_id)
+	{
+		barrier->barrier(thread_id);
+	});
+
+	const double c_abi = run_crossings("gtmp_barrier", num_threads, num_iters, Team::Persistent, [](int, unsigned)
+	{
+		gtmp_barrier();
+	});
+
+	const double inlined = run_crossings("Inlined barrier()", num_threads, num_iters, Team::Persistent, [barrier](int, unsigned)
+	{
+		barrier->barrier();
+	});
+
+	const double inlined_id = run_crossings("Inlined barrier(thread_id)", num_threads, num_iters, Team::Persistent, [barrier](int thread_id, unsigned)
+	{
+		barrier->barrier(thread_id);
+	});
+
+	aligned_delete(barrier);
 
+	const double c_abi_ns = c_abi * 1e9 / num_iters;
+	const double inlined_ns = inlined * 1e9 / num_iters;
+
+	std::cout << "gtmp_barrier: " + std::to_string(c_abi_ns) + "ns, inlined: " + std::to_string(inlined_ns)
+		+ "ns, inlined with the id passed in: " + std::to_string(inlined_id * 1e9 / num_iters) + "ns per crossing ("
+		+ std::to_string(inlined_ns / c_abi_ns) + "x gtmp_barrier)\n";
+}
+
+void run_inline(const ArgParse & args)
+{
+	const std::string & name = args.get_program();
+
+	if (name == "counter")
+	{
+		run_inline< CounterTeamBarrier<> >(args);
+	}
+	else if (name == "sharded")
+	{
+		run_inline< ShardedTeamBarrier<> >(args);
+	}
+	else if (name == "mcs")
+	{
+		// gtmp_barrier() runs the tuned configuration, set GTMP_MCS_CONFIG=4x2 to compare like with like
+		run_inline< McsTeamBarrier<> >(args);
+	}
+	else if (name == "tree")
+	{
+		run_inline< CombiningTeamBarrier<> >(args);
+	}
+	else if (name == "dynamic")
+	{
+		run_inline< DynamicTeamBarrier<> >(args);
+	}
+	else if (name == "dissemination")
+	{
+		run_inline< DisseminationTeamBarrier<> >(args);
+	}
+	else if (name == "tournament")
+	{
+		run_inline< TournamentTeamBarrier<> >(args);
+	}
+	else if (name == "adaptive")
+	{
+		run_inline< AdaptiveTeamBarrier<> >(args);
+	}
+	else if (name == "hierarchical")
+	{
+		run_inline< HierarchicalTeamBarrier<> >(args);
+	}
+	else
+	{
+		std::cerr << "No header-only version of " + name + " in barriers.h\n";
+		std::exit(1);
+	}
+}
+
+// Barrier is the header-only twin of the algorithm of this executable. One
+// thread moves the team to the next phase, here a shared word every thread
+// reads back, either between two crossings or as the completion step of one.
+template <class Barrier>
+void run_complete(const ArgParse & args)
+{
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+	const Team team = args.get_team();
+
+	// Created outside of the team, see barriers.h
+	Barrier * barrier = aligned_new<Barrier>(num_threads);
+
+	// Written by one thread between two crossings, read by all after the second.
+	unsigned phase = 0;
+
+	const double three_step = run_crossings("Barrier, omp single, barrier", num_threads, num_iters, team,
+		[barrier, &phase](int thread_id, unsigned iter)
+	{
+		barrier->barrier(thread_id);
+
+		#pragma omp single nowait
+		{
+			phase = iter + 1;
+		}
+
+		barrier->barrier(thread_id);
+
+		BOOST_ASSERT(phase == iter + 1);
+	});
+
+	const double fused = run_crossings("Barrier with a completion step", num_threads, num_iters, team,
+		[barrier, &phase](int thread_id, unsigned iter)
+	{
+		const unsigned result = barrier->barrier_complete(thread_id, [&phase, iter]
+		{
+			phase = iter + 1;
+			return phase;
+		});
+
+		BOOST_ASSERT(result == iter + 1);
+		(void)result;
+	});
+
+	// The same with a completion step that returns nothing: the word is read
+	// back from memory, as after the second barrier above.
+	const double fused_void = run_crossings("Barrier with a void completion step", num_threads, num_iters, team,
+		[barrier, &phase](int thread_id, unsigned iter)
+	{
+		barrier->barrier_complete(thread_id, [&phase, iter]
+		{
+			phase = iter + 1;
+		});
+
+		BOOST_ASSERT(phase == iter + 1);
+		(void)iter;
+	});
+
+	aligned_delete(barrier);
+
+	std::cout << "Barrier, omp single, barrier: " + std::to_string(three_step * 1e9 / num_iters)
+		+ "ns, completion step: " + std::to_string(fused * 1e9 / num_iters)
+		+ "ns, void completion step: " + std::to_string(fused_void * 1e9 / num_iters) + "ns per phase change\n";
+}
+
+void run_complete(const ArgParse & args)
+{
+	const std::string & name = args.get_program();
+
+	if (name == "counter")
+	{
+		run_complete< CounterTeamBarrier<> >(args);
+	}
+	else if (name == "mcs")
+	{
+		run_complete< McsTeamBarrier<> >(args);
+	}
+	else if (name == "tree")
+	{
+		run_complete< CombiningTeamBarrier<> >(args);
+	}
+	else
+	{
+		std::cout << "No barrier with a completion step for " + name + " in barriers.h\n";
+	}
+}
+
+// Forks num_procs processes, each of which maps a new shared memory segment
+// at an address of its own, and crosses the barrier that create(mem) set up
+// at mem in it through the callable attach(mem) returns: first a check as
+// in check_barrier(), then num_iters timed crossings. Returns the seconds
+// of the slowest process. Exits if any process fails, once all have
+// finished: a process that stops crossing early gets the others killed.
+template <class Create, class Attach>
+double run_processes(const std::string & name, int num_procs, unsigned num_iters, size_t barrier_size,
+	Create create, Attach attach)
+{
+	struct alignas(LEVEL1_DCACHE_LINESIZE) Slot
+	{
+		std::atomic<unsigned> count{ 0 };
+		double seconds = 0;
+	};
+
+	const unsigned num_check = std::min(num_iters, 1000u);
+	const size_t barrier_offset = sizeof(Slot) * unsigned(num_procs);
+	const std::string segment_name = "/gtmp-" + std::to_string(getpid());
+
+	ShmSegment segment = ShmSegment::create(segment_name, barrier_offset + barrier_size);
+
+	Slot * slots = static_cast<Slot *>(segment.get());
+	for (int p = 0; p < num_procs; ++p)
+	{
+		new (&slots[p]) Slot();
+	}
+	create(static_cast<char *>(segment.get()) + barrier_offset);
+
+	Profiler profiler(name);
+	std::cout.flush();
+
+	auto participate = [&](int id)
+	{
+		// The parent's mapping is still there, so this one is elsewhere.
+		ShmSegment view = ShmSegment::open(segment_name);
+		char * const mem = static_cast<char *>(view.get());
+		Slot * const my_slots = reinterpret_cast<Slot *>(mem);
+
+		auto cross = attach(mem + barrier_offset);
+
+		// A failed check still crosses as many times as everyone else, or
+		// the other processes would wait for it forever.
+		bool passed = true;
+		for (unsigned i = 0; i < num_check; ++i)
+		{
+			const unsigned mine = my_slots[id].count.fetch_add(1, std::memory_order_relaxed) + 1;
+
+			cross(id);
+
+			if (id < num_procs - 1)
+			{
+				const unsigned next = my_slots[id + 1].count.load(std::memory_order_relaxed);
+				passed = passed && (next == mine || next == mine + 1);
+			}
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < num_iters; ++i)
+		{
+			cross(id);
+		}
+		my_slots[id].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		return passed ? 0 : 2;
+	};
+
+	// Exit status of a process that did not cross as many times as the
+	// others, and left them waiting.
+	const int kAbandoned = 1;
+
+	std::vector<pid_t> pids;
+	bool abandoned = false;
+	for (int id = 0; id < num_procs; ++id)
+	{
+		const pid_t pid = fork();
+		if (pid == 0)
+		{
+			int status = kAbandoned;
+			try
+			{
+				status = participate(id);
+			}
+			catch (const std::exception & e)
+			{
+				std::cerr << std::string(e.what()) + "\n";
+			}
+			_exit(status);
+		}
+		if (pid < 0)
+		{
+			std::cerr << "fork failed\n";
+			abandoned = true;
+			break;
+		}
+		pids.push_back(pid);
+	}
+
+	if (abandoned)
+	{
+		for (pid_t pid : pids)
+		{
+			kill(pid, SIGKILL);
+		}
+	}
+
+	// Only the processes not reaped yet are killed, their pids cannot be reused.
+	int num_failed = 0;
+	while (!pids.empty())
+	{
+		int status = 0;
+		const pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+		{
+			break;
+		}
+		pids.erase(std::remove(pids.begin(), pids.end(), pid), pids.end());
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		{
+			continue;
+		}
+
+		++num_failed;
+		const bool crossed_all = WIFEXITED(status) && WEXITSTATUS(status) != kAbandoned;
+		if (!crossed_all && !abandoned)
+		{
+			abandoned = true;
+			for (pid_t other : pids)
+			{
+				kill(other, SIGKILL);
+			}
+		}
+	}
+
+	if (abandoned || num_failed != 0)
+	{
+		std::cerr << name + ": " + std::to_string(num_failed) + " processes failed\n";
+
+		// std::exit() skips the destructor, which removes the name.
+		segment = ShmSegment();
+		std::exit(1);
+	}
+
+	double seconds = 0;
+	for (int p = 0; p < num_procs; ++p)
+	{
+		seconds = std::max(seconds, slots[p].seconds);
+	}
+	return seconds;
+}
+
+// Barrier is the process-shared twin of the algorithm of this executable.
+template <class Barrier>
+void run_process(const ArgParse & args, const std::string & name)
+{
+	const int num_procs = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+
+	const double pthread = run_processes("pthread_barrier_wait", num_procs, num_iters, sizeof(pthread_barrier_t),
+		[num_procs](void * mem)
+	{
+		pthread_barrierattr_t attr;
+		pthread_barrierattr_init(&attr);
+		pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_barrier_init(static_cast<pthread_barrier_t *>(mem), &attr, unsigned(num_procs));
+		pthread_barrierattr_destroy(&attr);
+	},
+		[](void * mem)
+	{
+		pthread_barrier_t * barrier = static_cast<pthread_barrier_t *>(mem);
+		return [barrier](int) { pthread_barrier_wait(barrier); };
+	});
+
+	const double shared = run_processes(name, num_procs, num_iters, Barrier::get_size(num_procs),
+		[num_procs](void * mem)
+	{
+		Barrier::create(mem, num_procs);
+	},
+		[](void * mem)
+	{
+		Barrier * barrier = Barrier::attach(mem);
+		return [barrier](int id) { barrier->barrier(id); };
+	});
+
+	const double pthread_ns = pthread * 1e9 / num_iters;
+	const double shared_ns = shared * 1e9 / num_iters;
+
+	std::cout << "pthread_barrier_wait: " + std::to_string(pthread_ns) + "ns, " + name + ": "
+		+ std::to_string(shared_ns) + "ns per crossing (" + std::to_string(shared_ns / pthread_ns)
+		+ "x pthread_barrier_wait) over " + std::to_string(num_procs) + " processes\n";
+}
+
+void run_process(const ArgParse & args)
+{
+	const std::string & name = args.get_program();
+
+	if (name == "counter")
+	{
+		run_process< ShmCounterBarrier<> >(args, "ShmCounterBarrier");
+	}
+	else if (name == "mcs")
+	{
+		run_process< ShmMcsTree<> >(args, "ShmMcsTree");
+	}
+	else if (name == "tree")
+	{
+		run_process< ShmCombiningTree<> >(args, "ShmCombiningTree");
+	}
+	else
+	{
+		std::cout << "No process-shared version of " + name + " in shm_barriers.h\n";
+	}
+}
+
+// Barrier is the header-only twin of the algorithm of this executable, as a
+// template over the wait policy, layout and thread id source. The tasks make
+// as many slices as the team crosses barriers, 16 slices per task.
+template <template <class, class, class> class Barrier>
+void run_tasks(const ArgParse & args)
+{
+	const unsigned kSlicesPerTask = 16;
+
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+	const Team team = args.get_team();
+	const Workload & load = args.get_workload();
+	const unsigned slice_units = args.get_work() != 0 ? args.get_work() : 256;
+
+	const uint64_t num_tasks = (uint64_t(num_iters) * unsigned(num_threads) + kSlicesPerTask - 1) / kSlicesPerTask;
+	const uint64_t num_slices = num_tasks * kSlicesPerTask;
+
+	auto fill = [&](TaskPool & pool)
+	{
+		for (uint64_t i = 0; i < num_tasks; ++i)
+		{
+			unsigned slices_left = kSlicesPerTask;
+			pool.push(int(i % unsigned(num_threads)), [slices_left, slice_units]() mutable
+			{
+				do_private_work(slice_units);
+				return --slices_left != 0;
+			});
+		}
+	};
+
+	auto drain = [num_threads](const std::string & name, TaskPool & pool)
+	{
+		Profiler p(name);
+
+		#pragma omp parallel num_threads(num_threads)
+		{
+			pool.run_all(omp_get_thread_num());
+		}
+
+		return p.get_elapsed_seconds();
+	};
+
+	// Created outside of the team, see barriers.h
+	using SpinningBarrier = Barrier<PauseWait, EnvLayout, OmpThreadId>;
+	using TaskingBarrier = Barrier<TaskWait<>, EnvLayout, OmpThreadId>;
+	SpinningBarrier * spinning = aligned_new<SpinningBarrier>(num_threads);
+	TaskingBarrier * tasking = aligned_new<TaskingBarrier>(num_threads);
+
+	const double spin_phases = run_crossings("Phases, spinning waits", num_threads, num_iters, team,
+		[&load, spinning](int thread_id, unsigned iter)
+	{
+		do_private_work(load.get_units(thread_id, iter));
+		spinning->barrier(thread_id);
+	});
+
+	TaskPool spin_pool(num_threads);
+	fill(spin_pool);
+	const double spin_tasks = drain("Tasks after the phases", spin_pool);
+
+	TaskPool pool(num_threads);
+	fill(pool);
+
+	const double task_phases = run_crossings("Phases, waits running tasks", num_threads, num_iters, team,
+		[&load, &pool, tasking](int thread_id, unsigned iter)
+	{
+		do_private_work(load.get_units(thread_id, iter));
+
+		TaskPool::Binding binding(pool, thread_id);
+		tasking->barrier(thread_id);
+	});
+
+	const uint64_t slices_in_waits = pool.get_num_slices();
+	const int64_t max_slice_ns = pool.get_max_slice_ns();
+	const uint64_t num_overruns = pool.get_num_overruns();
+	const double rest_tasks = drain("Rest of the tasks", pool);
+
+	aligned_delete(tasking);
+	aligned_delete(spinning);
+
+	// CPU time the slices run in waits would have taken on their own.
+	const double reclaimed = double(slices_in_waits) * (slice_units / measure_work_rate());
+
+	std::cout << "Spinning waits: " + std::to_string(spin_phases) + "s of phases, then " + std::to_string(spin_tasks)
+		+ "s of tasks, " + std::to_string(spin_phases + spin_tasks) + "s in all\n";
+	std::cout << "Waits running tasks: " + std::to_string(task_phases) + "s of phases, then " + std::to_string(rest_tasks)
+		+ "s of tasks, " + std::to_string(task_phases + rest_tasks) + "s in all\n";
+	std::cout << std::to_string(slices_in_waits) + " of " + std::to_string(num_slices) + " slices ran in barrier waits, "
+		+ std::to_string(reclaimed) + "s of CPU time reclaimed. Longest slice " + std::to_string(max_slice_ns)
+		+ "ns, " + std::to_string(num_overruns) + " over the budget of " + std::to_string(pool.get_max_slice_budget_ns())
+		+ "ns (GTMP_TASK_MAX_SLICE_NS), phases slower by " + std::to_string((task_phases - spin_phases) * 1e9 / num_iters) + "ns per crossing\n";
+}
+
+void run_tasks(const ArgParse & args)
+{
+	const std::string & name = args.get_program();
+
+	if (name == "counter")
+	{
+		run_tasks<CounterTeamBarrier>(args);
+	}
+	else if (name == "sharded")
+	{
+		run_tasks<ShardedTeamBarrier>(args);
+	}
+	else if (name == "mcs")
+	{
+		run_tasks<McsTeamBarrier>(args);
+	}
+	else if (name == "tree")
+	{
+		run_tasks<CombiningTeamBarrier>(args);
+	}
+	else if (name == "dynamic")
+	{
+		run_tasks<DynamicTeamBarrier>(args);
+	}
+	else if (name == "dissemination")
+	{
+		run_tasks<DisseminationTeamBarrier>(args);
+	}
+	else if (name == "tournament")
+	{
+		run_tasks<TournamentTeamBarrier>(args);
+	}
+	else if (name == "adaptive")
+	{
+		run_tasks<AdaptiveTeamBarrier>(args);
+	}
+	else if (name == "hierarchical")
+	{
+		run_tasks<HierarchicalTeamBarrier>(args);
+	}
+	else
+	{
+		std::cerr << "No header-only version of " + name + " in barriers.h\n";
+		std::exit(1);
+	}
+}
+
+// Report is LatencyReport or LoadReport.
+template <class Report>
+void write_report(const ArgParse & args, const Report & report)
+{
+	std::ofstream file;
+	bool new_file = true;
+
+	if (!args.get_out().empty())
+	{
+		new_file = !std::ifstream(args.get_out()).good();
+		file.open(args.get_out(), std::ios::app);
+		if (!file)
+		{
+			std::cerr << "Cannot open " + args.get_out() + "\n";
+			std::exit(1);
+		}
+	}
+
+	std::ostream & os = file.is_open() ? file : std::cout;
+
+	if (args.get_format() == "csv")
+	{
+		report.write_csv(os, new_file);
+	}
+	else if (args.get_format() == "json")
+	{
+		report.write_json(os);
+	}
+	else
+	{
+		report.write_text(os);
+	}
+}
+
+void run_latency(const ArgParse & args)
+{
+	const unsigned kMaxSamplesPerThread = 1 << 18;
+
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+	const Workload & load = args.get_workload();
+	const Team team = args.get_team();
+
+	unsigned sample_interval = args.get_sample_interval();
+	if (sample_interval == 0)
+	{
+		sample_interval = std::max(1u, (num_iters + kMaxSamplesPerThread - 1) / kMaxSamplesPerThread);
+	}
+
+	LatencyRecorder recorder(num_threads, num_iters, sample_interval);
+
+	// Calibrates the clock before the timed loop.
+	std::cout << "TSC: " + std::to_string(1 / TscClock::get_ns_per_tick()) + " ticks/ns, timing every "
+		+ std::to_string(recorder.get_sample_interval()) + " crossings\n";
+
+	const double seconds = run_crossings("Timed crossings", num_threads, num_iters, team,
+		[&recorder, &load](int thread_id, unsigned iter)
+	{
+		do_private_work(load.get_units(thread_id, iter));
+
+		if (!recorder.is_sampled(iter))
+		{
+			gtmp_barrier();
+			return;
+		}
+
+		const uint64_t arrive = TscClock::now();
+		gtmp_barrier();
+		recorder.record(thread_id, iter, arrive, TscClock::now());
+	});
+
+	LatencyReport report;
+	report.name = args.get_program();
+	report.num_threads = num_threads;
+	report.num_iters = num_iters;
+	report.crossings_per_second = num_iters / seconds;
+	report.perf = s_last_perf;
+	recorder.summarize(report);
+
+	write_report(args, report);
+}
+
+void run_load(const ArgParse & args)
+{
+	const int num_threads = args.get_num_threads();
+	const unsigned num_iters = args.get_num_iters();
+	const Workload & load = args.get_workload();
+
+	const double units_per_second = measure_work_rate();
+
+	const double seconds = run_crossings("Phases of " + load.get_spec(), num_threads, num_iters, args.get_team(),
+		[&load](int thread_id, unsigned iter)
+	{
+		do_private_work(load.get_units(thread_id, iter));
+		gtmp_barrier();
+	});
+
+	// With an ideal barrier, a phase lasts as long as its slowest thread's work.
+	double ideal_units = 0;
+	for (unsigned i = 0; i < num_iters; ++i)
+	{
+		unsigned max_units = 0;
+		for (int t = 0; t < num_threads; ++t)
+		{
+			max_units = std::max(max_units, load.get_units(t, i));
+		}
+		ideal_units += max_units;
+	}
+
+	LoadReport report;
+	report.name = args.get_program();
+	report.spec = load.get_spec();
+	report.num_threads = num_threads;
+	report.num_iters = num_iters;
+	report.seconds = seconds;
+	report.ideal_seconds = ideal_units / units_per_second;
+	report.perf = s_last_perf;
+
+	write_report(args, report);
+}
+
+int main(int argc, char ** argv)
+{
+	// Get num threads
+	const ArgParse args(argc, argv);
+	const int num_threads = args.get_num_threads();
+
+	// Disable dynamic threading
+	omp_set_dynamic(0);
+	BOOST_ASSERT(omp_get_dynamic() == 0);
+
+	omp_set_num_threads(num_threads);
+
+
+	gtmp_init(num_threads);
+
+	s_count_perf = args.get_perf();
+
+	if (args.get_mode() != "nested")
+	{
+		const Team team = args.get_mode() == "omp" ? Team::Persistent : args.get_team();
+		check_barrier(num_threads, std::min(args.get_num_iters(), 1000u), team);
+	}
+
+	if (args.get_mode() == "split")
+	{
+		run_split(args);
+	}
+	else if (args.get_mode() == "reduce")
+	{
+		run_reduce(args);
+	}
+	else if (args.get_mode() == "nested")
+	{
+		run_nested(args);
+	}
+	else if (args.get_mode() == "sibling")
+	{
+		run_sibling(args);
+	}
+	else if (args.get_mode() == "latency")
+	{
+		run_latency(args);
+	}
+	else if (args.get_mode() == "omp")
+	{
+		run_omp(args);
+	}
+	else if (args.get_mode() == "load")
+	{
+		run_load(args);
+	}
+	else if (args.get_mode() == "inline")
+	{
+		run_inline(args);
+	}
+	else if (args.get_mode() == "litmus")
+	{
+		run_litmus(args);
+	}
+	else if (args.get_mode() == "complete")
+	{
+		run_complete(args);
+	}
+	else if (args.get_mode() == "process")
+	{
+		run_process(args);
+	}
+	else if (args.get_mode() == "tasks")
+	{
+		run_tasks(args);
+	}
+	else
+	{
+		run_crossings("Parallel Section", num_threads, args.get_num_iters(), args.get_team(), [](int, unsigned)
+		{
+			gtmp_barrier();
+		});
+	}
+
+
+	gtmp_finalize();
+
+	return 0;
+}
@@ -0,0 +1,690 @@
+#ifndef INC_MCS_TREE_H
+#define INC_MCS_TREE_H
+
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <memory>
+
+#include <boost/assert.hpp>
+#include <boost/integer.hpp>
+#include <boost/range/irange.hpp>
+
+#include "strong_int.h"
+#include "wait_policy.h"
+#include "reduce_ops.h"
+#include "node_arena.h"
+
+/*
+    From the MCS Paper: A scalable, distributed tree-based barrier with only local spinning.
+
+    type treenode = record
+        parentsense : Boolean
+	parentpointer : ^Boolean
+	childpointers : array [0..1] of ^Boolean
+	havechild : array [0..3] of Boolean
+	childnotready : array [0..3] of Boolean
+	dummy : Boolean //pseudo-data
+
+    shared nodes : array [0..P-1] of treenode
+        // nodes[vpid] is allocated in shared memory
+        // locally accessible to processor vpid
+    processor private vpid : integer // a unique virtual processor index
+    processor private sense : Boolean
+
+    // on processor i, sense is initially true
+    // in nodes[i]:
+    //    havechild[j] = true if 4 * i + j + 1 < P; otherwise false
+    //    parentpointer = &nodes[floor((i-1)/4].childnotready[(i-1) mod 4],
+    //        or dummy if i = 0
+    //    childpointers[0] = &nodes[2*i+1].parentsense, or &dummy if 2*i+1 >= P
+    //    childpointers[1] = &nodes[2*i+2].parentsense, or &dummy if 2*i+2 >= P
+    //    initially childnotready = havechild and parentsense = false
+
+    procedure tree_barrier
+        with nodes[vpid] do
+	    repeat until childnotready = {false, false, false, false}
+	    childnotready := havechild //prepare for next barrier
+	    parentpointer^ := false //let parent know I'm ready
+	    // if not root, wait until my parent signals wakeup
+	    if vpid != 0
+	        repeat until parentsense = sense
+	    // signal children in wakeup tree
+	    childpointers[0]^ := sense
+	    childpointers[1]^ := sense
+	    sense := not sense
+
+    Split-phase variant used below: every node has one more arrival bit for its
+    own thread, and whichever thread sets the last missing bit of a node resets
+    the word and carries the arrival on to the parent (fetch_or, no spinning), so
+    arriving never blocks. The sense is replaced by an episode counter per node:
+    the thread completing the root bumps the root's episode, and every thread,
+    once it sees its own node's episode reach the one it arrived for, passes it
+    on to its wakeup children.
+
+    All the tree index math is done once in init: every thread gets a plan,
+    on its own cache line, with the indices of its node, its parent and its
+    wakeup children and the masks and initial words it needs, so that a
+    crossing only loads, stores and spins. Climbing the arrival tree reads
+    the plan of each node completed on the way, which nobody writes to.
+
+    BasicMcsTree is all of the above, and finds node i and its plan through
+    the derived class, so that the same tree runs on node arenas here and
+    in a block of shared memory in shm_barriers.h. In GenericMcsTree, node i
+    and its plan are placed on the NUMA node of the thread that spins on
+    node i (node_arena.h).
+*/
+
+struct NodeIdTag {};
+using NodeId = StrongInt<unsigned, NodeIdTag>;
+
+
+template <class Derived, unsigned ArriveK, unsigned WakeupK, class WaitPolicy>
+class BasicMcsTree
+{
+    static_assert(ArriveK > 0, "");
+    static_assert(WakeupK > 0, "");
+    static_assert(ArriveK < 64, "One arrival bit is reserved for the node's own thread");
+
+public:
+
+    using Token = typename WaitWord<WaitPolicy>::Word;
+
+    static constexpr unsigned kArriveK = ArriveK;
+    static constexpr unsigned kWakeupK = WakeupK;
+
+    void barrier(int omp_thread_num)
+    {
+        barrier(omp_thread_num, [] {});
+    }
+
+    // Same as barrier(), but the thread completing the root runs root_hook()
+    // once everyone has arrived and before anyone is woken up. Used to stack
+    // barriers on top of each other (see gtmp_hierarchical.cpp).
+    template <class RootHook>
+    void barrier(int omp_thread_num, RootHook && root_hook)
+    {
+        wait(omp_thread_num, arrive(omp_thread_num, root_hook));
+    }
+
+    Token arrive(int omp_thread_num)
+    {
+        return arrive(omp_thread_num, [] {});
+    }
+
+    template <class RootHook>
+    Token arrive(int omp_thread_num, RootHook && root_hook)
+    {
+        return arrive_impl<false>(omp_thread_num, 0, NoReduce(), [&root_hook](ReduceWord &) { root_hook(); });
+    }
+
+    void wait(int omp_thread_num, Token episode)
+    {
+        wait_impl<false>(omp_thread_num, episode);
+    }
+
+    // Barrier fused with a reduction: every thread contributes value, values
+    // are combined with op up the arrival tree, and the result comes back
+    // down the wakeup tree to every thread. op must be associative and
+    // commutative, and all threads must pass the same op in an episode.
+    template <class T, class Op>
+    T barrier_reduce(int omp_thread_num, const T & value, Op op)
+    {
+        const Token episode = arrive_impl<true>(omp_thread_num, to_reduce_word(value), WordOp<T, Op>{ op }, [](ReduceWord &) {});
+        wait_impl<true>(omp_thread_num, episode);
+
+        return from_reduce_word<T>( get_node(to_index(omp_thread_num)).get_result() );
+    }
+
+    // Barrier with a completion step, as the CompletionFunction of C++20
+    // std::barrier: the thread completing the root runs completion() before
+    // anyone is woken up, and what it returns comes down the wakeup tree to
+    // every thread, as a reduction result does.
+    template <class Completion>
+    CompletionResult<Completion> barrier_complete(int omp_thread_num, Completion && completion)
+    {
+        // Nothing comes down the tree for a completion that returns void.
+        constexpr bool kWithResult = !std::is_void< CompletionResult<Completion> >::value;
+
+        const Token episode = arrive_impl<kWithResult>(omp_thread_num, 0, NoReduce(), [&completion](ReduceWord & value)
+        {
+            value = run_completion(completion);
+        });
+        wait_impl<kWithResult>(omp_thread_num, episode);
+
+        return from_completion_word<Completion>( get_node(to_index(omp_thread_num)).get_result() );
+    }
+
+    bool test(int omp_thread_num, Token episode)
+    {
+        const unsigned inode = to_index(omp_thread_num);
+
+        if ( !get_node(inode).is_released(episode) )
+        {
+            return false;
+        }
+
+        wake_up_children(inode, episode);
+        return true;
+    }
+
+
+protected:
+
+    static constexpr unsigned kNone = ~0u;
+
+    // One bit per arrival child plus the own thread's.
+    using ArrivalWord = typename std::conditional<(ArriveK < 32), uint32_t, uint64_t>::type;
+
+    class alignas(LEVEL1_DCACHE_LINESIZE) Node
+    {
+
+        static constexpr const unsigned kMaxChildren = std::numeric_limits<ArrivalWord>::digits;
+
+        static constexpr ArrivalWord get_initial_arrival_word(unsigned num_children_to_arrive)
+        {
+            if (num_children_to_arrive == kMaxChildren)
+            {
+                return 0;
+            }
+
+            BOOST_ASSERT(num_children_to_arrive < kMaxChildren);
+
+            ArrivalWord word = 1;
+
+            word = (word << num_children_to_arrive);
+
+            --word;
+
+            word = ~word;
+
+            return (word);
+        }
+
+        static constexpr ArrivalWord get_all_arrived_word()
+        {
+            ArrivalWord all_arrived = 0;
+            all_arrived = ~all_arrived;
+            return all_arrived;
+        }
+
+        // Some simple tests
+        static_assert( get_initial_arrival_word(kMaxChildren) == 0 , "If node has kMaxChildren children, initial arrival word should be all 0s" );
+        static_assert( get_initial_arrival_word(0) == get_all_arrived_word() , "If node has 0 children, initial arrival word should be all 1s" );
+
+    public:
+
+        Node(unsigned num_children_to_arrive) :
+            m_arrival_word( get_initial_arrival_word(num_children_to_arrive + 1) ),
+            m_episode(0)
+        {
+
+        }
+
+        // No copying allowed: Node objects must stay in the arena as is.
+        Node(const Node &) = delete;
+        Node & operator=(const Node &) = delete;
+
+        Token get_episode() const
+        {
+            return m_episode.load(std::memory_order_relaxed);
+        }
+
+        // Returns true if this set the last missing bit, in which case the word
+        // has been reset for the next episode. Nobody can arrive here again
+        // before this node is released, so resetting right away is safe.
+        //
+        // mask has bit nth_bit set. With a reduction, value is published in
+        // the slot of nth_bit before the bit is set, and the completing thread
+        // gets the combination of all slots back in value.
+        template <class ReduceOp>
+        bool mark_arrive(unsigned nth_bit, ArrivalWord mask, unsigned num_children_to_arrive, ArrivalWord initial_word,
+                         ReduceWord & value, ReduceOp op)
+        {
+            if (ReduceOp::kEnabled)
+            {
+                m_slots[nth_bit] = value;
+            }
+
+            // acq_rel: publishes the slot and everything before this arrival,
+            // and the completing thread acquires the whole word's history.
+            const ArrivalWord old_word = m_arrival_word.fetch_or(mask, std::memory_order_acq_rel);
+            BOOST_ASSERT( (old_word & mask) == 0 );
+
+            if ( (old_word | mask) != get_all_arrived_word() )
+            {
+                return false;
+            }
+
+            if (ReduceOp::kEnabled)
+            {
+                value = m_slots[num_children_to_arrive];
+                for (unsigned i = 0; i < num_children_to_arrive; ++i)
+                {
+                    value = op(value, m_slots[i]);
+                }
+            }
+
+            m_arrival_word.store(initial_word, std::memory_order_relaxed);
+            return true;
+        }
+
+        static ArrivalWord get_initial_word(unsigned num_children_to_arrive)
+        {
+            return get_initial_arrival_word(num_children_to_arrive + 1);
+        }
+
+        ReduceWord get_result() const
+        {
+            return m_result;
+        }
+
+        void set_result(ReduceWord result)
+        {
+            m_result = result;
+        }
+
+        void wait_released(Token episode)
+        {
+            m_episode.wait_until([episode](Token cur) { return is_reached(cur, episode); });
+        }
+
+        bool is_released(Token episode) const
+        {
+            return is_reached(m_episode.load(), episode);
+        }
+
+        void wakeup(Token episode)
+        {
+            m_episode.store(episode);
+        }
+
+    private:
+
+        // Wrap-around safe "cur >= episode".
+        static bool is_reached(Token cur, Token episode)
+        {
+            return static_cast<int32_t>(cur - episode) >= 0;
+        }
+
+        std::atomic<ArrivalWord> m_arrival_word;
+        WaitWord<WaitPolicy> m_episode;
+
+        // Reduction values: one slot per arrival child plus one for the own
+        // thread, published before the arrival bit is set. m_result is written
+        // before m_episode by whoever releases this node.
+        ReduceWord m_slots[ArriveK + 1] = {};
+        ReduceWord m_result = 0;
+    };
+
+    // Everything the owner of a node needs to cross the barrier, and that a
+    // thread climbing through the node needs to carry on to the parent.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Plan
+    {
+        unsigned parent = kNone;        // Arrival parent, kNone at the root
+        unsigned wakeup_begin = 0;      // Wakeup children are the num_wakeup nodes from wakeup_begin
+        unsigned num_wakeup = 0;
+        unsigned own_slot = 0;          // Also the number of arrival children
+        unsigned slot_in_parent = 0;
+        ArrivalWord own_mask = 0;
+        ArrivalWord mask_in_parent = 0; // Bit of node in the parent
+        ArrivalWord initial_word = 0;   // node's arrival word for a new episode
+    };
+
+    BasicMcsTree() = default;
+
+    // Must be set before any node is built.
+    void set_num_nodes(int num_nodes)
+    {
+        BOOST_ASSERT(num_nodes > 0);
+        m_num_nodes = NodeId(static_cast<unsigned>(num_nodes));
+    }
+
+    NodeId get_num_nodes() const
+    {
+        return m_num_nodes;
+    }
+
+    Node * build_node(void * mem, unsigned inode) const
+    {
+        return new (mem) Node( get_num_children_to_arrive( NodeId(inode) ) );
+    }
+
+    Plan * build_plan(void * mem, unsigned inode) const
+    {
+        Plan * plan = new (mem) Plan();
+        const NodeId id(inode);
+
+        plan->own_slot = get_num_children_to_arrive(id);
+        plan->own_mask = ArrivalWord(1) << plan->own_slot;
+        plan->initial_word = Node::get_initial_word(plan->own_slot);
+
+        const NodeId iparent = get_parent_id_to_arrive(id);
+        if (iparent.is_valid())
+        {
+            plan->parent = iparent.valid_base();
+            plan->slot_in_parent = which_arrival_child(id);
+            plan->mask_in_parent = ArrivalWord(1) << plan->slot_in_parent;
+        }
+
+        const auto wakeup_range = get_children_id_range_to_wake_up(id);
+        if (wakeup_range.first.is_valid())
+        {
+            plan->wakeup_begin = wakeup_range.first.valid_base();
+            plan->num_wakeup = (wakeup_range.second - wakeup_range.first).valid_base();
+        }
+
+        return plan;
+    }
+
+
+private:
+
+    Node & get_node(unsigned i)
+    {
+        return static_cast<Derived *>(this)->get_node(i);
+    }
+
+    const Plan & get_plan(unsigned i)
+    {
+        return static_cast<Derived *>(this)->get_plan(i);
+    }
+
+    unsigned to_index(int omp_thread_num) const
+    {
+        BOOST_ASSERT( omp_thread_num >= 0 && NodeId(static_cast<unsigned>(omp_thread_num)) < get_num_nodes() );
+        return static_cast<unsigned>(omp_thread_num);
+    }
+
+    // root_hook(value) runs on the reduced value, which is published to
+    // the wakeup tree when kWithResult.
+    template <bool kWithResult, class ReduceOp, class RootHook>
+    Token arrive_impl(int omp_thread_num, ReduceWord value, ReduceOp op, RootHook && root_hook)
+    {
+        unsigned inode = to_index(omp_thread_num);
+        Node * node = &get_node(inode);
+        const Plan * plan = &get_plan(inode);
+
+        // The node cannot be released before its own thread has arrived.
+        const Token episode = node->get_episode() + 1;
+
+        // Step 1: set own bit, and carry the arrival up for as long as this thread completes nodes
+        unsigned slot = plan->own_slot;
+        ArrivalWord mask = plan->own_mask;
+
+        while ( node->mark_arrive(slot, mask, plan->own_slot, plan->initial_word, value, op) )
+        {
+            if (plan->parent == kNone)
+            {
+                // Step 2: completed the root, release it
+                root_hook(value);
+                if (kWithResult)
+                {
+                    node->set_result(value);
+                }
+                node->wakeup(episode);
+                break;
+            }
+
+            slot = plan->slot_in_parent;
+            mask = plan->mask_in_parent;
+            inode = plan->parent;
+            node = &get_node(inode);
+            plan = &get_plan(inode);
+        }
+
+        return episode;
+    }
+
+    template <bool kWithResult>
+    void wait_impl(int omp_thread_num, Token episode)
+    {
+        const unsigned inode = to_index(omp_thread_num);
+
+        // Step 3: spin until the own node is released
+        get_node(inode).wait_released(episode);
+
+        wake_up_children<kWithResult>(inode, episode);
+    }
+
+    template <bool kWithResult = false>
+    void wake_up_children(unsigned inode, Token episode)
+    {
+        const Plan & plan = get_plan(inode);
+        const ReduceWord result = kWithResult ? get_node(inode).get_result() : 0;
+
+        // Step 4: spread the episode (and the reduced value) to wakeup children
+        for (unsigned i = 0; i < plan.num_wakeup; ++i)
+        {
+            Node & child = get_node(plan.wakeup_begin + i);
+            if (kWithResult)
+            {
+                child.set_result(result);
+            }
+            child.wakeup(episode);
+        }
+    }
+
+
+    // Utilities to traverse up and down an array tree.
+    // This class is unaware of the tree size, and
+    // assumes the tree expands from root indefinitely.
+    // You have to handle nodes with incomplete or no children.
+    template <unsigned K>
+    class NodeFinder
+    {
+        static_assert(K > 0, "");
+
+    public:
+
+        static NodeId get_parent_id(NodeId ichild)
+        {
+            unsigned raw = ichild.valid_base();
+
+            if (raw == 0)
+            {
+                return NodeId();
+            }
+
+            return NodeId( (raw - 1u) / K );
+        }
+
+        static std::pair<NodeId, NodeId> get_children_id_range(NodeId iparent)
+        {
+            unsigned raw = iparent.valid_base();
+
+            unsigned begin = raw * K + 1;
+            unsigned end = begin + K;
+
+            return std::make_pair( NodeId(begin), NodeId(end) );
+        }
+
+    private:
+
+    };
+
+    NodeId check_node_id(NodeId id) const
+    {
+        BOOST_ASSERT( id.is_valid() );
+        BOOST_ASSERT( id >= NodeId(0) );
+        BOOST_ASSERT( id < get_num_nodes() );
+
+        return id;
+    }
+
+    NodeId check_node_id_casual(NodeId id) const
+    {
+        if ( id.is_valid() )
+        {
+            BOOST_ASSERT( id >= NodeId(0) );
+            BOOST_ASSERT( id < get_num_nodes() );
+        }
+
+        return id;
+    }
+
+    NodeId check_node_id_end(NodeId id) const
+    {
+        BOOST_ASSERT( id.is_valid() );
+        BOOST_ASSERT( id >= NodeId(0) );
+        BOOST_ASSERT( id <= get_num_nodes() );
+
+        return id;
+    }
+
+
+    // Helpers to go up and down the arrival or wakeup trees, that know
+    // the tree size. (Handles less than K child list properly.)
+    NodeId get_parent_id_to_arrive(NodeId ichild) const
+    {
+        BOOST_ASSERT(ichild < get_num_nodes());
+
+        NodeFinder<ArriveK> node_finder;
+        return check_node_id_casual(node_finder.get_parent_id(ichild));
+    }
+
+    template <unsigned K>
+    auto get_children_id_range(NodeId iparent) const
+    {
+        BOOST_ASSERT(iparent < get_num_nodes());
+
+        NodeFinder<K> node_finder;
+        auto range = node_finder.get_children_id_range(iparent);
+        BOOST_ASSERT(range.first < range.second);
+
+        range.second = std::min(range.second, get_num_nodes());
+
+        if (range.first >= range.second)
+        {
+            range.first = NodeId();
+            range.second = NodeId();
+        }
+        else
+        {
+            range.first = check_node_id(range.first);
+            range.second = check_node_id_end(range.second);
+            BOOST_ASSERT(range.first < range.second);
+        }
+
+        return range;
+    }
+
+    auto get_children_id_range_to_wake_up(NodeId iparent) const
+    {
+        return get_children_id_range<WakeupK>(iparent);
+    }
+
+    auto get_children_id_range_to_arrive(NodeId iparent) const
+    {
+        return get_children_id_range<ArriveK>(iparent);
+    }
+
+    unsigned get_num_children_to_arrive(NodeId iparent) const
+    {
+        auto range = get_children_id_range_to_arrive(iparent);
+        if (!range.first.is_valid() && !range.second.is_valid())
+        {
+            return 0;
+        }
+        BOOST_ASSERT(range.first.is_valid() && range.second.is_valid());
+        BOOST_ASSERT(range.second > range.first);
+        NodeId size = range.second - range.first;
+        return boost::numeric_cast<unsigned>( size.valid_base() );
+    }
+
+    unsigned which_arrival_child(NodeId ichild) const
+    {
+        BOOST_ASSERT(ichild.is_valid());
+
+        NodeId arrival_parent = get_parent_id_to_arrive(ichild);
+
+        if (!arrival_parent.is_valid())
+        {
+            return std::numeric_limits<unsigned>::max();
+        }
+
+        auto child_range = get_children_id_range_to_arrive(arrival_parent);
+        NodeId begin_child = (child_range.first);
+        NodeId end_child = (child_range.second);
+
+        BOOST_ASSERT(begin_child.is_valid());
+        BOOST_ASSERT(end_child.is_valid());
+        BOOST_ASSERT(ichild >= begin_child);
+        BOOST_ASSERT(ichild < end_child);
+
+        return ichild.valid_base() - begin_child.valid_base();
+    }
+
+    NodeId m_num_nodes; // Used to tell member functions the number of nodes during the construction of the nodes
+};
+
+
+template <unsigned ArriveK, unsigned WakeupK, class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class GenericMcsTree : public BasicMcsTree<GenericMcsTree<ArriveK, WakeupK, WaitPolicy, Layout>, ArriveK, WakeupK, WaitPolicy>
+{
+    using Base = BasicMcsTree<GenericMcsTree, ArriveK, WakeupK, WaitPolicy>;
+    friend Base;
+
+    using typename Base::Node;
+    using typename Base::Plan;
+
+public:
+
+    GenericMcsTree() = default;
+
+
+    // Must be called outside of any parallel region, so that every node
+    // can be placed by the thread that will use it.
+    void init(int omp_num_threads)
+    {
+        init(omp_num_threads, omp_num_threads, [](unsigned inode) { return static_cast<int>(inode); });
+    }
+
+    // Tree of num_nodes nodes used by only some threads of a team of
+    // team_size: node i is placed near team thread owner(i).
+    template <class Owner>
+    void init(int num_nodes, int team_size, Owner owner)
+    {
+        *this = GenericMcsTree();
+
+        Base::set_num_nodes(num_nodes);
+
+        const size_t size = static_cast<size_t>(num_nodes);
+        auto owner_of = [&owner](size_t i) { return owner(static_cast<unsigned>(i)); };
+
+        m_nodes.create(size, team_size, owner_of, [this](size_t i, void * mem)
+        {
+            Base::build_node(mem, static_cast<unsigned>(i));
+        });
+
+        m_plans.create(size, team_size, owner_of, [this](size_t i, void * mem)
+        {
+            Base::build_plan(mem, static_cast<unsigned>(i));
+        });
+    }
+
+
+private:
+
+    Node & get_node(unsigned i)
+    {
+        return m_nodes[i];
+    }
+
+    const Plan & get_plan(unsigned i) const
+    {
+        return m_plans[i];
+    }
+
+    ArenaArray<Node, Layout> m_nodes;
+    ArenaArray<Plan, Layout> m_plans;   // Indexed by thread, node i's plan sits next to it
+};
+
+using McsTree = GenericMcsTree<4, 2>;
+
+#endif
@@ -0,0 +1,505 @@
+#ifndef INC_NODE_ARENA_H
+#define INC_NODE_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#include <boost/assert.hpp>
+
+#include "cpu_topology.h"
+
+/*
+    Storage for the per-thread state of a barrier (nodes, flags, plans), placed
+    in memory local to the thread that spins on it, as the MCS paper assumes
+    for nodes[vpid].
+
+    An ArenaArray<T> is one mmap'ed block of n elements at sizeof(T) stride,
+    i.e. cache line stride for the line aligned nodes of the barriers. Every
+    element has an owner, the team thread that spins on it. In a parallel
+    region of the team, each owner reports its NUMA node, every page is bound
+    to the node that owns most of the elements in it, and then the owners
+    construct their elements, so the pages get allocated where they are bound.
+
+    Pages are only shared between nodes where the owners' nodes change, once
+    per boundary if consecutive threads run on the same node, as with
+    OMP_PROC_BIND=close. Placing each element on a page of its own avoids
+    even that, at the cost of one page and one TLB entry per element.
+
+    Environment:
+        GTMP_NUMA       local   (default) pages bound to their elements' owners' node
+                        remote  pages bound to the node after that one, to measure
+                                what locality buys
+                        page    one page per element, bound to its owner's node
+                        packed  no binding, all elements constructed by the
+                                creating thread, i.e. the plain heap layout
+        GTMP_HUGEPAGES  1 backs arenas with huge pages (MAP_HUGETLB if reserved,
+                        transparent huge pages otherwise). A huge page cannot be
+                        split between nodes, so this implies packed. A MAP_HUGETLB
+                        arena takes whole huge pages, of the size in /proc/meminfo.
+
+    If mbind is not available, placement falls back to the owner's first touch.
+    Without OpenMP, there is no team to start: the creating thread constructs
+    every element, on its own node.
+
+    The Layout parameter of ArenaArray fixes the placement at compile time
+    instead (see the layout policies below), the barriers pass theirs on.
+*/
+
+namespace ArenaDetails
+{
+    enum class Placement
+    {
+        Local,
+        Remote,
+        Page,
+        Packed
+    };
+
+    struct Config
+    {
+        Placement placement = Placement::Local;
+        bool huge_pages = false;
+    };
+
+    inline Config read_config()
+    {
+        Config config;
+
+        const char * env = std::getenv("GTMP_NUMA");
+        if (env)
+        {
+            const std::string val(env);
+            if (val == "remote")
+            {
+                config.placement = Placement::Remote;
+            }
+            else if (val == "page")
+            {
+                config.placement = Placement::Page;
+            }
+            else if (val == "packed")
+            {
+                config.placement = Placement::Packed;
+            }
+            else if (val != "local")
+            {
+                std::cerr << "gtmp: ignoring unknown GTMP_NUMA \"" + val + "\", expected local, remote, page or packed\n";
+            }
+        }
+
+        const char * env_huge = std::getenv("GTMP_HUGEPAGES");
+        config.huge_pages = env_huge && std::string(env_huge) == "1";
+        if (config.huge_pages)
+        {
+            config.placement = Placement::Packed;
+        }
+
+        return config;
+    }
+
+    inline const Config & get_config()
+    {
+        static const Config config = read_config();
+        return config;
+    }
+
+    inline size_t get_page_size()
+    {
+        static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return page_size;
+    }
+
+    inline size_t round_up(size_t size, size_t align)
+    {
+        return (size + align - 1) / align * align;
+    }
+
+    // Default huge page size, from the Hugepagesize line of /proc/meminfo,
+    // or 2MB if it cannot be read.
+    inline size_t read_huge_page_size()
+    {
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        while (meminfo >> key)
+        {
+            size_t kb = 0;
+            if (key == "Hugepagesize:" && meminfo >> kb && kb > 0)
+            {
+                return kb * 1024;
+            }
+            meminfo.ignore(1024, '\n');
+        }
+        return size_t(2) << 20;
+    }
+
+    inline size_t get_huge_page_size()
+    {
+        static const size_t huge_page_size = read_huge_page_size();
+        return huge_page_size;
+    }
+
+    // NUMA node of the CPU the calling thread runs on.
+    inline int get_current_node()
+    {
+#if defined(__linux__)
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        {
+            return static_cast<int>(node);
+        }
+#endif
+        return 0;
+    }
+
+    // Best effort: on failure the pages simply follow the first touch.
+    inline void bind_to_node(void * addr, size_t len, int node)
+    {
+#if defined(__linux__)
+        unsigned long mask[4] = {};
+        const size_t bits_per_word = 8 * sizeof(unsigned long);
+        if (node < 0 || static_cast<size_t>(node) >= bits_per_word * 4)
+        {
+            return;
+        }
+        mask[static_cast<size_t>(node) / bits_per_word] = 1ul << (static_cast<size_t>(node) % bits_per_word);
+        syscall(SYS_mbind, addr, len, MPOL_BIND, mask, bits_per_word * 4, MPOL_MF_MOVE);
+#else
+        (void)addr;
+        (void)len;
+        (void)node;
+#endif
+    }
+
+    // Binds each page of the array at base to the node of most of the elements
+    // that start in it, element_nodes[i] being the node of element i, with one
+    // call per run of pages on the same node. A page in which no element starts
+    // goes with the page before it.
+    inline void bind_pages(char * base, size_t stride, const std::vector<int> & element_nodes)
+    {
+        const size_t page_size = get_page_size();
+        const size_t n = element_nodes.size();
+
+        std::vector<size_t> counts(static_cast<size_t>(*std::max_element(element_nodes.begin(), element_nodes.end())) + 1);
+
+        size_t run_begin = 0;
+        int run_node = element_nodes[0];
+        size_t i = 0;
+
+        for (size_t page = 0; page < n * stride; page += page_size)
+        {
+            std::fill(counts.begin(), counts.end(), 0);
+            for (; i < n && i * stride < page + page_size; ++i)
+            {
+                ++counts[static_cast<size_t>(element_nodes[i])];
+            }
+
+            const auto most = std::max_element(counts.begin(), counts.end());
+            const int node = *most > 0 ? static_cast<int>(most - counts.begin()) : run_node;
+
+            if (node != run_node)
+            {
+                bind_to_node(base + run_begin, page - run_begin, run_node);
+                run_begin = page;
+                run_node = node;
+            }
+        }
+
+        bind_to_node(base + run_begin, round_up(n * stride, page_size) - run_begin, run_node);
+    }
+
+    struct Mapping
+    {
+        void * mem;
+        size_t len;         // What to munmap, len rounded up to the pages used
+        bool huge;          // MAP_HUGETLB pages, which cannot be bound per node
+    };
+
+    // len is a multiple of the base page size.
+    inline Mapping map(size_t len, bool huge_pages)
+    {
+#if defined(MAP_HUGETLB)
+        if (huge_pages)
+        {
+            const size_t huge_len = round_up(len, get_huge_page_size());
+            void * mem = mmap(nullptr, huge_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mem != MAP_FAILED)
+            {
+                return Mapping{ mem, huge_len, true };
+            }
+        }
+#endif
+
+        void * mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+
+#if defined(MADV_HUGEPAGE)
+        if (huge_pages)
+        {
+            madvise(mem, len, MADV_HUGEPAGE);
+        }
+#endif
+
+        return Mapping{ mem, len, false };
+    }
+}
+
+
+// Layout policies: where an ArenaArray puts its elements.
+//
+//   EnvLayout      as set by GTMP_NUMA and GTMP_HUGEPAGES (default)
+//   LocalLayout    pages bound to the node of their elements' owners
+//   PageLayout     page per element, on its owner's node
+//   PackedLayout   no binding, constructed by the creating thread
+struct EnvLayout
+{
+    static ArenaDetails::Config get_config()
+    {
+        return ArenaDetails::get_config();
+    }
+};
+
+struct LocalLayout
+{
+    static ArenaDetails::Config get_config()
+    {
+        return ArenaDetails::Config();
+    }
+};
+
+struct PageLayout
+{
+    static ArenaDetails::Config get_config()
+    {
+        ArenaDetails::Config config;
+        config.placement = ArenaDetails::Placement::Page;
+        return config;
+    }
+};
+
+struct PackedLayout
+{
+    static ArenaDetails::Config get_config()
+    {
+        ArenaDetails::Config config;
+        config.placement = ArenaDetails::Placement::Packed;
+        return config;
+    }
+};
+
+
+template <class T, class Layout = EnvLayout>
+class ArenaArray
+{
+public:
+
+    ArenaArray() = default;
+
+    ArenaArray(const ArenaArray &) = delete;
+    ArenaArray & operator=(const ArenaArray &) = delete;
+
+    ArenaArray(ArenaArray && other) noexcept
+    {
+        swap(other);
+    }
+
+    ArenaArray & operator=(ArenaArray && other) noexcept
+    {
+        ArenaArray(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~ArenaArray()
+    {
+        clear();
+    }
+
+    // Builds n elements. construct(i, mem) placement-constructs element i in
+    // mem, from the thread owner(i) of a parallel region of team_size threads.
+    // If no full team can be started (nested region without nesting, or no
+    // OpenMP), the calling thread constructs every element.
+    template <class Owner, class Construct>
+    void create(size_t n, int team_size, Owner owner, Construct construct)
+    {
+        using namespace ArenaDetails;
+
+        clear();
+
+        if (n == 0)
+        {
+            return;
+        }
+
+        const Config config = Layout::get_config();
+
+        const bool page_per_element = config.placement == Placement::Page;
+
+        m_stride = page_per_element ? round_up(sizeof(T), get_page_size()) : sizeof(T);
+        const Mapping mapping = map(round_up(n * m_stride, get_page_size()), config.huge_pages);
+        m_base = static_cast<char *>(mapping.mem);
+        m_mapped = mapping.len;
+        m_size = n;
+
+        auto construct_at = [this, &construct](size_t i)
+        {
+            construct(i, static_cast<void *>(m_base + i * m_stride));
+        };
+
+        // Huge pages are not bound either, see GTMP_HUGEPAGES.
+        if (config.placement == Placement::Packed || mapping.huge)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                construct_at(i);
+            }
+            return;
+        }
+
+        const int num_nodes = read_num_numa_nodes();
+
+        // Filled in by the owners, before any page is touched.
+        std::vector<int> element_nodes(n, 0);
+
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(team_size)
+        {
+            const int thread_id = omp_get_thread_num();
+            const bool full_team = omp_get_num_threads() == team_size;
+#else
+        (void)team_size;
+        {
+            const int thread_id = 0;
+            const bool full_team = false;
+#endif
+
+            auto is_mine = [&owner, thread_id, full_team](size_t i)
+            {
+                return full_team ? owner(i) == thread_id : thread_id == 0;
+            };
+
+            int node = get_current_node();
+            if (config.placement == Placement::Remote)
+            {
+                node = (node + 1) % num_nodes;
+            }
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (is_mine(i))
+                {
+                    element_nodes[i] = node;
+                }
+            }
+
+            if (page_per_element)
+            {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    if (is_mine(i))
+                    {
+                        bind_to_node(m_base + i * m_stride, m_stride, node);
+                    }
+                }
+            }
+            else
+            {
+#ifdef _OPENMP
+                #pragma omp barrier
+                #pragma omp single
+#endif
+                bind_pages(m_base, m_stride, element_nodes);
+            }
+
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (is_mine(i))
+                {
+                    construct_at(i);
+                }
+            }
+        }
+    }
+
+    void clear()
+    {
+        if (!m_base)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < m_size; ++i)
+        {
+            (*this)[i].~T();
+        }
+
+        munmap(m_base, m_mapped);
+
+        m_base = nullptr;
+        m_size = 0;
+        m_stride = 0;
+        m_mapped = 0;
+    }
+
+    T & operator[](size_t i)
+    {
+        BOOST_ASSERT(i < m_size);
+        return *reinterpret_cast<T *>(m_base + i * m_stride);
+    }
+
+    const T & operator[](size_t i) const
+    {
+        BOOST_ASSERT(i < m_size);
+        return *reinterpret_cast<const T *>(m_base + i * m_stride);
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    // Distance in bytes between two consecutive elements.
+    size_t get_stride() const
+    {
+        return m_stride;
+    }
+
+    void swap(ArenaArray & other) noexcept
+    {
+        std::swap(m_base, other.m_base);
+        std::swap(m_size, other.m_size);
+        std::swap(m_stride, other.m_stride);
+        std::swap(m_mapped, other.m_mapped);
+    }
+
+private:
+
+    char * m_base = nullptr;
+    size_t m_size = 0;
+    size_t m_stride = 0;
+    size_t m_mapped = 0;
+};
+
+#endif
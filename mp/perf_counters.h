@@ -0,0 +1,389 @@
+#ifndef INC_PERF_COUNTERS_H
+#define INC_PERF_COUNTERS_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iomanip>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <boost/assert.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware event counts of a team, through one perf_event_open group per
+// thread (user space only, so perf_event_paranoid=2 is enough).
+//
+// Coherence events such as HITM have no generic perf encoding, pass the
+// model specific raw code in GTMP_PERF_RAW (e.g. 0x04d2 is
+// MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM on Skylake).
+//
+// Any event the kernel or the container refuses is reported unavailable,
+// the run goes on either way.
+
+struct PerfCounts
+{
+	enum Event : unsigned
+	{
+		Cycles,
+		Instructions,
+		CacheReferences,
+		CacheMisses,
+		L1dMisses,
+		Raw,
+		kNumEvents
+	};
+
+	static const char * get_name(unsigned event)
+	{
+		static const char * names[kNumEvents] =
+			{ "cycles", "instructions", "cache_references", "cache_misses", "l1d_misses", "raw" };
+		return names[event];
+	}
+
+	// Per thread and crossing, scaled up if the group was multiplexed.
+	double values[kNumEvents] = {};
+	bool available[kNumEvents] = {};
+	std::string reason;         // Why nothing could be counted, empty otherwise
+
+	bool is_enabled() const
+	{
+		return m_enabled;
+	}
+
+	void set_enabled(bool enabled)
+	{
+		m_enabled = enabled;
+	}
+
+	void write_text(std::ostream & os) const
+	{
+		if (!m_enabled)
+		{
+			return;
+		}
+
+		os << "perf per thread and crossing:";
+		for (unsigned e = 0; e < kNumEvents; ++e)
+		{
+			os << " " << get_name(e) << " " << format(e);
+		}
+		if (!reason.empty())
+		{
+			os << " (" << reason << ")";
+		}
+		os << "\n";
+	}
+
+	// Columns are always written, NA when not counted, so that runs with and
+	// without counters can share a table.
+	static void write_csv_header(std::ostream & os)
+	{
+		for (unsigned e = 0; e < kNumEvents; ++e)
+		{
+			os << "," << get_name(e);
+		}
+	}
+
+	void write_csv(std::ostream & os) const
+	{
+		for (unsigned e = 0; e < kNumEvents; ++e)
+		{
+			os << "," << format(e);
+		}
+	}
+
+	void write_json(std::ostream & os) const
+	{
+		os << ", \"perf\": {";
+		for (unsigned e = 0; e < kNumEvents; ++e)
+		{
+			os << (e ? ", " : "") << "\"" << get_name(e) << "\": " << (m_enabled && available[e] ? format(e) : "null");
+		}
+		os << "}";
+	}
+
+private:
+
+	std::string format(unsigned event) const
+	{
+		if (!m_enabled || !available[event])
+		{
+			return "NA";
+		}
+		std::ostringstream oss;
+		oss << std::fixed << std::setprecision(2) << values[event];
+		return oss.str();
+	}
+
+	bool m_enabled = false;
+};
+
+
+namespace PerfDetails
+{
+#if defined(__linux__)
+	struct EventSpec
+	{
+		uint32_t type;
+		uint64_t config;
+	};
+
+	inline bool get_event_spec(unsigned event, EventSpec & spec)
+	{
+		switch (event)
+		{
+		case PerfCounts::Cycles:
+			spec = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES };
+			return true;
+		case PerfCounts::Instructions:
+			spec = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS };
+			return true;
+		case PerfCounts::CacheReferences:
+			spec = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES };
+			return true;
+		case PerfCounts::CacheMisses:
+			spec = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES };
+			return true;
+		case PerfCounts::L1dMisses:
+			spec = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+				| (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+			return true;
+		case PerfCounts::Raw:
+		{
+			const char * env = std::getenv("GTMP_PERF_RAW");
+			if (!env)
+			{
+				return false;
+			}
+			spec = { PERF_TYPE_RAW, std::strtoull(env, nullptr, 0) };
+			return true;
+		}
+		}
+		return false;
+	}
+
+	inline int open_event(const EventSpec & spec, int group_fd)
+	{
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = spec.type;
+		attr.config = spec.config;
+		attr.disabled = group_fd == -1 ? 1 : 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+	}
+#endif
+}
+
+
+// Events of the calling thread.
+class PerfGroup
+{
+public:
+
+	PerfGroup()
+	{
+#if defined(__linux__)
+		for (unsigned e = 0; e < PerfCounts::kNumEvents; ++e)
+		{
+			PerfDetails::EventSpec spec;
+			if (!PerfDetails::get_event_spec(e, spec))
+			{
+				continue;
+			}
+
+			const int fd = PerfDetails::open_event(spec, m_leader);
+			if (fd < 0)
+			{
+				if (m_leader < 0 && m_error.empty())
+				{
+					m_error = std::string("perf_event_open: ") + std::strerror(errno);
+				}
+				continue;
+			}
+
+			if (m_leader < 0)
+			{
+				m_leader = fd;
+			}
+			m_fds.push_back(fd);
+			m_events.push_back(e);
+		}
+#else
+		m_error = "perf_event_open is Linux only";
+#endif
+	}
+
+	PerfGroup(const PerfGroup &) = delete;
+	PerfGroup & operator=(const PerfGroup &) = delete;
+
+	~PerfGroup()
+	{
+#if defined(__linux__)
+		for (int fd : m_fds)
+		{
+			close(fd);
+		}
+#endif
+	}
+
+	bool is_open() const
+	{
+		return m_leader >= 0;
+	}
+
+	const std::string & get_error() const
+	{
+		return m_error;
+	}
+
+	void start()
+	{
+#if defined(__linux__)
+		if (is_open())
+		{
+			ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+	}
+
+	// Adds the counts since start() to totals, and marks the events counted.
+	void stop(double * totals, bool * available)
+	{
+#if defined(__linux__)
+		if (!is_open())
+		{
+			return;
+		}
+
+		ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+		// { nr, time_enabled, time_running, value[nr] }
+		std::vector<uint64_t> buf(3 + m_fds.size());
+		const ssize_t size = read(m_leader, buf.data(), buf.size() * sizeof(uint64_t));
+		if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)) || buf[0] != m_fds.size() || buf[2] == 0)
+		{
+			return;
+		}
+
+		const double scale = double(buf[1]) / double(buf[2]);
+		for (size_t i = 0; i < m_fds.size(); ++i)
+		{
+			totals[m_events[i]] += double(buf[3 + i]) * scale;
+			available[m_events[i]] = true;
+		}
+#else
+		(void)totals;
+		(void)available;
+#endif
+	}
+
+private:
+	int m_leader = -1;
+	std::vector<int> m_fds;
+	std::vector<unsigned> m_events;
+	std::string m_error;
+};
+
+
+#ifdef _OPENMP
+// One PerfGroup per thread of the team. start() and stop() each run their own
+// parallel region, so they rely on the runtime giving the same OS threads
+// to consecutive teams of the same size, as libgomp does.
+class TeamPerfCounters
+{
+public:
+
+	explicit TeamPerfCounters(int num_threads) :
+		m_num_threads(num_threads)
+	{
+	}
+
+	void start()
+	{
+		#pragma omp parallel num_threads(m_num_threads)
+		{
+			PerfGroup *& group = get_thread_group();
+			delete group;
+			group = new PerfGroup();
+			group->start();
+		}
+	}
+
+	// Counts per thread and crossing since start().
+	PerfCounts stop(unsigned num_crossings)
+	{
+		PerfCounts counts;
+		counts.set_enabled(true);
+
+		#pragma omp parallel num_threads(m_num_threads)
+		{
+			PerfGroup *& group = get_thread_group();
+
+			#pragma omp critical (gtmp_perf_counters)
+			{
+				if (group)
+				{
+					group->stop(counts.values, counts.available);
+					if (!group->is_open() && counts.reason.empty())
+					{
+						counts.reason = group->get_error();
+					}
+				}
+			}
+
+			delete group;
+			group = nullptr;
+		}
+
+		const double divisor = double(m_num_threads) * std::max(num_crossings, 1u);
+		for (unsigned e = 0; e < PerfCounts::kNumEvents; ++e)
+		{
+			counts.values[e] /= divisor;
+		}
+
+		bool any = false;
+		for (bool available : counts.available)
+		{
+			any = any || available;
+		}
+		if (!any && counts.reason.empty())
+		{
+			counts.reason = "unavailable";
+		}
+
+		return counts;
+	}
+
+private:
+
+	static PerfGroup *& get_thread_group()
+	{
+		static thread_local PerfGroup * group = nullptr;
+		return group;
+	}
+
+	int m_num_threads;
+};
+#endif
+
+#endif
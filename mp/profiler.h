@@ -28,6 +28,11 @@ public:
 		std::cout << "Profiler: \"" + m_name + "\" started!\n";
 	}
 
+	double get_elapsed_seconds() const
+	{
+		return std::chrono::duration<double>(ProfilerDetails::now() - m_start).count();
+	}
+
 	~Profiler()
 	{
 		long double val = std::chrono::duration_cast<std::chrono::nanoseconds>(ProfilerDetails::now() - m_start).count();
@@ -0,0 +1,137 @@
+#ifndef INC_REDUCE_OPS_H
+#define INC_REDUCE_OPS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Barriers combine reduction values as raw 64-bit words, so that node layouts
+// do not depend on the value type. Any trivially copyable type of up to
+// 8 bytes can be reduced.
+using ReduceWord = uint64_t;
+
+template <class T>
+ReduceWord to_reduce_word(const T & val)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Reduced values are copied as raw bytes");
+    static_assert(sizeof(T) <= sizeof(ReduceWord), "Reduced values must fit in 64 bits");
+
+    ReduceWord word = 0;
+    std::memcpy(&word, &val, sizeof(T));
+    return word;
+}
+
+template <class T>
+T from_reduce_word(ReduceWord word)
+{
+    T val;
+    std::memcpy(&val, &word, sizeof(T));
+    return val;
+}
+
+// What a completion step (see barrier_complete() of the barriers) hands to
+// every thread: the value its callable returns, carried as a ReduceWord.
+template <class Completion>
+using CompletionResult = typename std::decay<decltype(std::declval<Completion &>()())>::type;
+
+// Runs a completion step and returns what it hands out as a ReduceWord,
+// nothing (0) for a completion that returns void. from_completion_word()
+// gives every thread back the value of the right type, or void.
+template <class Completion>
+ReduceWord run_completion(Completion & completion, std::false_type)
+{
+    return to_reduce_word< CompletionResult<Completion> >(completion());
+}
+
+template <class Completion>
+ReduceWord run_completion(Completion & completion, std::true_type)
+{
+    completion();
+    return 0;
+}
+
+template <class Completion>
+ReduceWord run_completion(Completion & completion)
+{
+    return run_completion(completion, std::is_void< CompletionResult<Completion> >());
+}
+
+template <class T>
+T from_completion_word(ReduceWord word, std::false_type)
+{
+    return from_reduce_word<T>(word);
+}
+
+template <class T>
+void from_completion_word(ReduceWord, std::true_type)
+{
+
+}
+
+template <class Completion>
+CompletionResult<Completion> from_completion_word(ReduceWord word)
+{
+    using T = CompletionResult<Completion>;
+    return from_completion_word<T>(word, std::is_void<T>());
+}
+
+// Associative and commutative operations. Combining order follows the tree shape,
+// not the thread ids.
+struct SumOp
+{
+    template <class T>
+    T operator()(const T & a, const T & b) const { return a + b; }
+};
+
+struct MinOp
+{
+    template <class T>
+    T operator()(const T & a, const T & b) const { return std::min(a, b); }
+};
+
+struct MaxOp
+{
+    template <class T>
+    T operator()(const T & a, const T & b) const { return std::max(a, b); }
+};
+
+struct AndOp
+{
+    template <class T>
+    T operator()(const T & a, const T & b) const { return a & b; }
+};
+
+struct OrOp
+{
+    template <class T>
+    T operator()(const T & a, const T & b) const { return a | b; }
+};
+
+// Lifts an operation on T to one on ReduceWord.
+template <class T, class Op>
+struct WordOp
+{
+    static constexpr bool kEnabled = true;
+
+    Op op;
+
+    ReduceWord operator()(ReduceWord a, ReduceWord b) const
+    {
+        return to_reduce_word<T>( op(from_reduce_word<T>(a), from_reduce_word<T>(b)) );
+    }
+};
+
+// Plain barrier: nothing to combine, and the barriers skip all value traffic.
+struct NoReduce
+{
+    static constexpr bool kEnabled = false;
+
+    ReduceWord operator()(ReduceWord a, ReduceWord) const
+    {
+        return a;
+    }
+};
+
+#endif
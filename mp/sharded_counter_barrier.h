@@ -0,0 +1,199 @@
+#ifndef INC_SHARDED_COUNTER_BARRIER_H
+#define INC_SHARDED_COUNTER_BARRIER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "node_arena.h"
+#include "cpu_topology.h"
+
+/*
+    The centralized barrier of counter_barrier.h with the count striped over
+    S cache lines, so that no more than a stripe's worth of threads fight
+    over one line:
+
+    arrive (thread i):
+        episode := shared episode + 1
+        if fetch_and_decrement (&stripe[i * S / P].count) = 1
+            stripe[i * S / P].count := size of the stripe
+            if fetch_and_decrement (&top) = 1
+                top := S
+                shared episode := episode
+        return episode
+
+    wait (episode):
+        repeat until shared episode = episode
+
+    Threads of a stripe are consecutive, so a stripe lines up with a package
+    when threads are placed in order. Everybody still waits on the one
+    shared episode word, as in the counter: one store releases the team.
+
+    S is the larger of the number of packages the process may run on and
+    P / kThreadsPerStripe, at most P. GTMP_SHARDS=S overrides it.
+*/
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class ShardedCounterBarrier
+{
+public:
+    using Token = typename WaitWord<WaitPolicy>::Word;
+
+    static constexpr int kThreadsPerStripe = 8;
+
+    ShardedCounterBarrier() = default;
+
+    ShardedCounterBarrier(const ShardedCounterBarrier &) = delete;
+    ShardedCounterBarrier & operator=(const ShardedCounterBarrier &) = delete;
+
+    // Must be called outside of any parallel region, see node_arena.h.
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        m_num_threads = num_threads;
+        m_num_stripes = choose_num_stripes(num_threads);
+
+        m_stripe_of.resize(static_cast<size_t>(num_threads));
+        std::vector<int> sizes(static_cast<size_t>(m_num_stripes), 0);
+        std::vector<int> owners(static_cast<size_t>(m_num_stripes), num_threads);
+        for (int t = 0; t < num_threads; ++t)
+        {
+            const int s = static_cast<int>(int64_t(t) * m_num_stripes / num_threads);
+            m_stripe_of[static_cast<size_t>(t)] = static_cast<unsigned>(s);
+            ++sizes[static_cast<size_t>(s)];
+            owners[static_cast<size_t>(s)] = std::min(owners[static_cast<size_t>(s)], t);
+        }
+
+        // Stripe s is placed near its first thread.
+        m_stripes.create(static_cast<size_t>(m_num_stripes), num_threads,
+            [&owners](size_t s) { return owners[s]; },
+            [&sizes](size_t s, void * mem)
+        {
+            Stripe * stripe = new (mem) Stripe();
+            stripe->size = sizes[s];
+            stripe->count.store(sizes[s]);
+        });
+
+        m_top_count.store(m_num_stripes);
+    }
+
+    void barrier(int thread_id)
+    {
+        barrier(thread_id, [] {});
+    }
+
+    // Same as barrier(), but the last thread to arrive runs last_hook()
+    // before releasing the others.
+    template <class LastHook>
+    void barrier(int thread_id, LastHook && last_hook)
+    {
+        wait(arrive(thread_id, last_hook));
+    }
+
+    Token arrive(int thread_id)
+    {
+        return arrive(thread_id, [] {});
+    }
+
+    template <class LastHook>
+    Token arrive(int thread_id, LastHook && last_hook)
+    {
+        BOOST_ASSERT(thread_id >= 0 && thread_id < m_num_threads);
+
+        // Cannot advance before this thread has arrived, see CounterBarrier.
+        const Token episode = m_episode.load(std::memory_order_relaxed) + 1;
+
+        Stripe & stripe = m_stripes[m_stripe_of[static_cast<size_t>(thread_id)]];
+
+        // acq_rel on both levels: the last arriver of a stripe acquires its
+        // stripe and releases it to the top, the last one there acquires all.
+        if (stripe.count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return episode;
+        }
+        stripe.count.store(stripe.size, std::memory_order_relaxed);
+
+        if (m_top_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return episode;
+        }
+        m_top_count.store(m_num_stripes, std::memory_order_relaxed);
+
+        last_hook();
+        m_episode.store(episode);
+
+        return episode;
+    }
+
+    void wait(Token episode)
+    {
+        // Stripes still expected, as a rough number of arrivals for
+        // proportional backoff.
+        const int remaining = m_top_count.load(std::memory_order_relaxed);
+
+        m_episode.wait_until([episode](Token cur) { return is_reached(cur, episode); },
+                             static_cast<unsigned>(std::max(remaining, 0)));
+    }
+
+    bool test(Token episode) const
+    {
+        return is_reached(m_episode.load(), episode);
+    }
+
+    int get_num_threads() const
+    {
+        return m_num_threads;
+    }
+
+    int get_num_stripes() const
+    {
+        return m_num_stripes;
+    }
+
+private:
+
+    // Wrap-around safe "cur >= episode".
+    static bool is_reached(Token cur, Token episode)
+    {
+        return static_cast<int32_t>(cur - episode) >= 0;
+    }
+
+    static int choose_num_stripes(int num_threads)
+    {
+        const char * env = std::getenv("GTMP_SHARDS");
+        if (env)
+        {
+            return std::max(1, std::min(std::atoi(env), num_threads));
+        }
+
+        std::set<int> packages;
+        for (const CpuInfo & cpu : read_allowed_cpus())
+        {
+            packages.insert(cpu.package);
+        }
+
+        const int by_size = (num_threads + kThreadsPerStripe - 1) / kThreadsPerStripe;
+        return std::min(std::max(static_cast<int>(packages.size()), by_size), num_threads);
+    }
+
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Stripe
+    {
+        std::atomic<int> count{ 0 };
+        int size = 0;
+    };
+
+    ArenaArray<Stripe, Layout> m_stripes;
+    std::vector<unsigned> m_stripe_of;      // Read-only after init
+    int m_num_threads = 0;
+    int m_num_stripes = 0;
+
+    alignas(LEVEL1_DCACHE_LINESIZE) std::atomic<int> m_top_count{ 0 };
+    alignas(LEVEL1_DCACHE_LINESIZE) WaitWord<WaitPolicy> m_episode;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef INC_SHM_BARRIERS_H
+#define INC_SHM_BARRIERS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "counter_barrier.h"
+#include "combining_tree.h"
+#include "mcs_tree.h"
+
+/*
+    Process-shared barriers, for worker processes forked on one host.
+
+    The barriers of barriers.h only work between the threads of one process:
+    their nodes are in node arenas linked by pointers, and the crossing thread
+    is found by a thread id source of thread_id.h. These keep all their state in one
+    block of shared memory, e.g. a ShmSegment (shm_segment.h), that every
+    process maps wherever mmap puts it:
+
+    - the nodes follow the barrier object in the block, found by their offset
+      from it and linked by index, so no address is ever stored
+    - every crossing passes the participant id, 0 .. P - 1, explicitly
+    - sleepers park where other processes can wake them (ProcessSharedWait)
+
+        mem = ...;  get_size(P) bytes, aligned to a cache line
+        B * b = B::create(mem, P);  once, before any participant crosses
+        B * b = B::attach(mem);     in every process, at its own address of mem
+        b->barrier(participant_id);
+
+    Nothing needs to be destroyed, unmapping the block is enough.
+
+    ShmCounterBarrier       the counter barrier of counter_barrier.h as is,
+                            it holds no pointer
+    ShmCombiningTree<K>     the combining tree of combining_tree.h, fan-in K,
+                            with its split-phase and global release
+    ShmMcsTree<A, W>        the MCS tree of mcs_tree.h, arrival fan-in A,
+                            wakeup fan-out W
+*/
+
+template <class WaitPolicy = ProcessSharedWait<DefaultWaitPolicy> >
+class alignas(LEVEL1_DCACHE_LINESIZE) ShmCounterBarrier
+{
+public:
+
+    static size_t get_size(int)
+    {
+        return sizeof(ShmCounterBarrier);
+    }
+
+    static ShmCounterBarrier * create(void * mem, int num_participants)
+    {
+        return new (mem) ShmCounterBarrier(num_participants);
+    }
+
+    static ShmCounterBarrier * attach(void * mem)
+    {
+        return static_cast<ShmCounterBarrier *>(mem);
+    }
+
+    ShmCounterBarrier(const ShmCounterBarrier &) = delete;
+    ShmCounterBarrier & operator=(const ShmCounterBarrier &) = delete;
+
+    void barrier(int participant_id)
+    {
+        BOOST_ASSERT(participant_id >= 0 && participant_id < m_counter.get_num_threads());
+        (void)participant_id;
+
+        m_counter.barrier();
+    }
+
+    int get_num_participants() const
+    {
+        return m_counter.get_num_threads();
+    }
+
+private:
+
+    explicit ShmCounterBarrier(int num_participants) :
+        m_counter(num_participants)
+    {
+
+    }
+
+    CounterBarrier<WaitPolicy> m_counter;
+};
+
+
+// The combining tree of combining_tree.h, nodes and participant states
+// following the object in the block, in that order. GTMP_TREE_RELEASE is
+// read by create(), and shared with every process that attaches.
+template <unsigned FanIn = GTMP_TREE_FANIN, class WaitPolicy = ProcessSharedWait<DefaultWaitPolicy> >
+class alignas(LEVEL1_DCACHE_LINESIZE) ShmCombiningTree :
+    public BasicCombiningTree<ShmCombiningTree<FanIn, WaitPolicy>, FanIn, WaitPolicy>
+{
+    using Base = BasicCombiningTree<ShmCombiningTree, FanIn, WaitPolicy>;
+    friend Base;
+
+    using typename Base::Node;
+    using typename Base::NodeShape;
+    using typename Base::State;
+
+public:
+
+    static size_t get_size(int num_participants)
+    {
+        return sizeof(ShmCombiningTree) + Base::get_num_nodes(num_participants) * sizeof(Node)
+            + static_cast<size_t>(num_participants) * sizeof(State);
+    }
+
+    static ShmCombiningTree * create(void * mem, int num_participants)
+    {
+        return new (mem) ShmCombiningTree(num_participants);
+    }
+
+    static ShmCombiningTree * attach(void * mem)
+    {
+        return static_cast<ShmCombiningTree *>(mem);
+    }
+
+    ShmCombiningTree(const ShmCombiningTree &) = delete;
+    ShmCombiningTree & operator=(const ShmCombiningTree &) = delete;
+
+    int get_num_participants() const
+    {
+        return m_num_participants;
+    }
+
+private:
+
+    explicit ShmCombiningTree(int num_participants) :
+        m_num_participants(num_participants),
+        m_num_nodes(Base::get_num_nodes(num_participants))
+    {
+        BOOST_ASSERT(num_participants > 0);
+
+        const std::vector<NodeShape> shapes = Base::get_node_shapes(num_participants);
+        for (unsigned i = 0; i < m_num_nodes; ++i)
+        {
+            new (&get_node(i)) Node(shapes[i]);
+        }
+
+        for (int i = 0; i < num_participants; ++i)
+        {
+            new (&get_state(i)) State();
+        }
+
+        Base::init_release();
+    }
+
+    // The nodes start right after this object, whatever its address, and the states after them.
+    Node & get_node(unsigned i)
+    {
+        BOOST_ASSERT(i < m_num_nodes);
+        return reinterpret_cast<Node *>(reinterpret_cast<char *>(this) + sizeof(ShmCombiningTree))[i];
+    }
+
+    State & get_state(int participant_id)
+    {
+        BOOST_ASSERT(participant_id >= 0 && participant_id < m_num_participants);
+        return reinterpret_cast<State *>(reinterpret_cast<char *>(&get_node(0)) + m_num_nodes * sizeof(Node))[participant_id];
+    }
+
+    int m_num_participants;
+    unsigned m_num_nodes;
+};
+
+
+// The MCS tree of mcs_tree.h, nodes and their plans following the object
+// in the block, in that order. Plans link nodes by index already.
+template <unsigned ArriveK = 4, unsigned WakeupK = 2, class WaitPolicy = ProcessSharedWait<DefaultWaitPolicy> >
+class alignas(LEVEL1_DCACHE_LINESIZE) ShmMcsTree :
+    public BasicMcsTree<ShmMcsTree<ArriveK, WakeupK, WaitPolicy>, ArriveK, WakeupK, WaitPolicy>
+{
+    using Base = BasicMcsTree<ShmMcsTree, ArriveK, WakeupK, WaitPolicy>;
+    friend Base;
+
+    using typename Base::Node;
+    using typename Base::Plan;
+
+public:
+
+    static size_t get_size(int num_participants)
+    {
+        return sizeof(ShmMcsTree) + static_cast<size_t>(num_participants) * (sizeof(Node) + sizeof(Plan));
+    }
+
+    static ShmMcsTree * create(void * mem, int num_participants)
+    {
+        return new (mem) ShmMcsTree(num_participants);
+    }
+
+    static ShmMcsTree * attach(void * mem)
+    {
+        return static_cast<ShmMcsTree *>(mem);
+    }
+
+    ShmMcsTree(const ShmMcsTree &) = delete;
+    ShmMcsTree & operator=(const ShmMcsTree &) = delete;
+
+    int get_num_participants() const
+    {
+        return m_num_participants;
+    }
+
+private:
+
+    explicit ShmMcsTree(int num_participants) :
+        m_num_participants(num_participants)
+    {
+        Base::set_num_nodes(num_participants);
+
+        for (unsigned i = 0; i < static_cast<unsigned>(num_participants); ++i)
+        {
+            Base::build_node(&get_node(i), i);
+            Base::build_plan(&get_plan(i), i);
+        }
+    }
+
+    // The nodes start right after this object, whatever its address, and the plans after them.
+    Node & get_node(unsigned i)
+    {
+        BOOST_ASSERT(i < static_cast<unsigned>(m_num_participants));
+        return reinterpret_cast<Node *>(reinterpret_cast<char *>(this) + sizeof(ShmMcsTree))[i];
+    }
+
+    Plan & get_plan(unsigned i)
+    {
+        BOOST_ASSERT(i < static_cast<unsigned>(m_num_participants));
+        return reinterpret_cast<Plan *>(reinterpret_cast<char *>(&get_node(0)) + static_cast<size_t>(m_num_participants) * sizeof(Node))[i];
+    }
+
+    int m_num_participants;
+};
+
+#endif
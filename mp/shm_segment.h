@@ -0,0 +1,145 @@
+#ifndef INC_SHM_SEGMENT_H
+#define INC_SHM_SEGMENT_H
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A named POSIX shared memory segment (shm_open + mmap), mapped read/write
+// wherever mmap puts it in this process. The process that created it
+// removes the name when its object goes, other processes only unmap.
+// Errors are thrown as std::system_error.
+class ShmSegment
+{
+public:
+
+    // Fails if the name exists. The segment starts zeroed, page aligned.
+    static ShmSegment create(const std::string & name, size_t size)
+    {
+        const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw_error("shm_open " + name);
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            const int err = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::system_error(err, std::generic_category(), "ftruncate " + name);
+        }
+
+        ShmSegment segment;
+        segment.m_name = name;
+        segment.m_owner = true;
+        segment.map(fd, size);
+        return segment;
+    }
+
+    // Maps an existing segment, at an address of its own.
+    static ShmSegment open(const std::string & name)
+    {
+        const int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+        {
+            throw_error("shm_open " + name);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            const int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "fstat " + name);
+        }
+
+        ShmSegment segment;
+        segment.m_name = name;
+        segment.map(fd, static_cast<size_t>(st.st_size));
+        return segment;
+    }
+
+    ShmSegment() = default;
+
+    ShmSegment(const ShmSegment &) = delete;
+    ShmSegment & operator=(const ShmSegment &) = delete;
+
+    ShmSegment(ShmSegment && other) noexcept
+    {
+        swap(other);
+    }
+
+    ShmSegment & operator=(ShmSegment && other) noexcept
+    {
+        ShmSegment(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~ShmSegment()
+    {
+        if (m_mem)
+        {
+            munmap(m_mem, m_size);
+        }
+        if (m_owner)
+        {
+            shm_unlink(m_name.c_str());
+        }
+    }
+
+    void swap(ShmSegment & other) noexcept
+    {
+        std::swap(m_name, other.m_name);
+        std::swap(m_mem, other.m_mem);
+        std::swap(m_size, other.m_size);
+        std::swap(m_owner, other.m_owner);
+    }
+
+    void * get() const
+    {
+        return m_mem;
+    }
+
+    size_t get_size() const
+    {
+        return m_size;
+    }
+
+private:
+
+    [[noreturn]] static void throw_error(const std::string & what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    // Takes over fd, the mapping keeps the segment alive without it.
+    void map(int fd, size_t size)
+    {
+        void * mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        const int err = errno;
+        close(fd);
+
+        if (mem == MAP_FAILED)
+        {
+            throw std::system_error(err, std::generic_category(), "mmap " + m_name);
+        }
+
+        m_mem = mem;
+        m_size = size;
+    }
+
+    std::string m_name;
+    void * m_mem = nullptr;
+    size_t m_size = 0;
+    bool m_owner = false;
+};
+
+#endif
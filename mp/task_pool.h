@@ -0,0 +1,374 @@
+#ifndef INC_TASK_POOL_H
+#define INC_TASK_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <boost/align/aligned_allocator.hpp>
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+
+/*
+    Low priority work for the threads that wait at a barrier.
+
+    The author of a task cuts it into slices: a task is a callable that runs
+    one slice and returns whether it has more to run, in which case it goes
+    back on the deque of the worker that ran it. Every worker has a deque,
+    takes its own tasks from the back, and steals the oldest task of another
+    worker when it has none.
+
+    TaskWait<B> is a wait policy (see wait_policy.h) that runs slices of the
+    pool bound to the waiting thread between polls of the barrier word, and
+    backs off with B when there is nothing to run. The word is polled before
+    every slice, so a waiter leaves at most one slice after its release.
+    Threads that release others on their way out (the tree barriers) pass that
+    delay on, once per level at most.
+
+    A slice cannot be preempted, so the delay is only bounded by the slicing.
+    Every slice gets a budget of GTMP_TASK_MAX_SLICE_NS nanoseconds (default
+    50000): a task with long or uneven slices polls is_slice_over() and
+    returns true to be run again later once it is. Slices that still run past
+    their budget are counted (get_num_overruns()), and the longest one is
+    measured (get_max_slice_ns()).
+
+        TaskPool pool(num_threads);
+        pool.push(worker, [state]() mutable { ...one slice...; return more; });
+
+        #pragma omp parallel
+        {
+            TaskPool::Binding binding(pool, omp_get_thread_num());
+            barrier.barrier();      // of a barrier with a TaskWait policy
+        }
+
+    Tasks may be pushed at any time from any thread, and must not cross a
+    barrier themselves. run_all() runs whatever is left, e.g. after the
+    barrier loop.
+*/
+class TaskPool
+{
+    // The worker a thread is bound to, see Binding.
+    struct Bound
+    {
+        TaskPool * pool = nullptr;
+        int worker = 0;
+    };
+
+public:
+
+    // Runs one slice, returns true if the task has more to run.
+    using Task = std::function<bool()>;
+
+    static constexpr unsigned kDefaultMaxSliceNs = 50000;
+
+    explicit TaskPool(int num_workers) :
+        m_workers(static_cast<size_t>(num_workers)),
+        m_max_slice_ns(read_max_slice_ns())
+    {
+        BOOST_ASSERT(num_workers > 0);
+    }
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool & operator=(const TaskPool &) = delete;
+
+    // Binds the calling thread to a worker of a pool for the waits of
+    // TaskWait, until destroyed.
+    class Binding
+    {
+    public:
+
+        Binding(TaskPool & pool, int worker) :
+            m_prev(get_bound())
+        {
+            BOOST_ASSERT(worker >= 0 && worker < pool.get_num_workers());
+            get_bound() = Bound{ &pool, worker };
+        }
+
+        ~Binding()
+        {
+            get_bound() = m_prev;
+        }
+
+        Binding(const Binding &) = delete;
+        Binding & operator=(const Binding &) = delete;
+
+    private:
+        Bound m_prev;
+    };
+
+    void push(int worker, Task task)
+    {
+        m_num_pending.fetch_add(1, std::memory_order_relaxed);
+        requeue(get_worker(worker), std::move(task));
+    }
+
+    // Runs one slice of the worker's latest task, or else of the oldest task
+    // of another worker. Returns false if there was nothing to take.
+    bool run_one(int worker)
+    {
+        if (m_num_pending.load(std::memory_order_relaxed) == 0)
+        {
+            return false;
+        }
+
+        Worker & w = get_worker(worker);
+
+        Task task;
+        if ( !pop(w, task) && !steal(worker, task) )
+        {
+            return false;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        get_slice_deadline() = start + std::chrono::nanoseconds(m_max_slice_ns);
+        const bool more = task();
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        // Only ever written by the thread bound to the worker.
+        ++w.num_slices;
+        w.max_slice_ns = std::max(w.max_slice_ns, ns);
+        if (ns > m_max_slice_ns)
+        {
+            ++w.num_overruns;
+        }
+
+        if (more)
+        {
+            requeue(w, std::move(task));
+        }
+        else
+        {
+            m_num_pending.fetch_sub(1, std::memory_order_release);
+        }
+
+        return true;
+    }
+
+    // Runs slices until every task pushed so far has finished, on any worker.
+    void run_all(int worker)
+    {
+        while (m_num_pending.load(std::memory_order_acquire) != 0)
+        {
+            if (!run_one(worker))
+            {
+                WaitDetails::cpu_relax();
+            }
+        }
+    }
+
+    // Runs a slice for the thread's binding, if any. See TaskWait.
+    static bool run_bound()
+    {
+        const Bound & bound = get_bound();
+        return bound.pool && bound.pool->run_one(bound.worker);
+    }
+
+    // Whether the slice running on this thread has used up its budget, for
+    // tasks to cut their slices short.
+    static bool is_slice_over()
+    {
+        return std::chrono::steady_clock::now() >= get_slice_deadline();
+    }
+
+    int64_t get_max_slice_budget_ns() const
+    {
+        return m_max_slice_ns;
+    }
+
+    int get_num_workers() const
+    {
+        return static_cast<int>(m_workers.size());
+    }
+
+    // Statistics, once the workers are done.
+    uint64_t get_num_slices() const
+    {
+        uint64_t num_slices = 0;
+        for (const Worker & w : m_workers)
+        {
+            num_slices += w.num_slices;
+        }
+        return num_slices;
+    }
+
+    int64_t get_max_slice_ns() const
+    {
+        int64_t max_ns = 0;
+        for (const Worker & w : m_workers)
+        {
+            max_ns = std::max(max_ns, w.max_slice_ns);
+        }
+        return max_ns;
+    }
+
+    // Slices that ran past get_max_slice_budget_ns().
+    uint64_t get_num_overruns() const
+    {
+        uint64_t num_overruns = 0;
+        for (const Worker & w : m_workers)
+        {
+            num_overruns += w.num_overruns;
+        }
+        return num_overruns;
+    }
+
+private:
+
+    static Bound & get_bound()
+    {
+        thread_local Bound s_bound;
+        return s_bound;
+    }
+
+    static std::chrono::steady_clock::time_point & get_slice_deadline()
+    {
+        thread_local std::chrono::steady_clock::time_point s_deadline;
+        return s_deadline;
+    }
+
+    static int64_t read_max_slice_ns()
+    {
+        const char * env = std::getenv("GTMP_TASK_MAX_SLICE_NS");
+        if (!env)
+        {
+            return kDefaultMaxSliceNs;
+        }
+        return std::max(1, std::atoi(env));
+    }
+
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Worker
+    {
+        std::atomic<bool> locked{ false };
+        std::atomic<unsigned> size{ 0 };    // Of tasks, read without the lock by thieves
+        std::deque<Task> tasks;
+
+        uint64_t num_slices = 0;
+        uint64_t num_overruns = 0;
+        int64_t max_slice_ns = 0;
+
+        void lock()
+        {
+            while (locked.exchange(true, std::memory_order_acquire))
+            {
+                WaitDetails::cpu_relax();
+            }
+        }
+
+        bool try_lock()
+        {
+            return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+        }
+
+        void unlock()
+        {
+            locked.store(false, std::memory_order_release);
+        }
+    };
+
+    Worker & get_worker(int worker)
+    {
+        BOOST_ASSERT(worker >= 0 && worker < get_num_workers());
+        return m_workers[static_cast<size_t>(worker)];
+    }
+
+    static void requeue(Worker & w, Task && task)
+    {
+        w.lock();
+        w.tasks.push_back(std::move(task));
+        w.size.store(static_cast<unsigned>(w.tasks.size()), std::memory_order_relaxed);
+        w.unlock();
+    }
+
+    static bool pop(Worker & w, Task & task)
+    {
+        if (w.size.load(std::memory_order_relaxed) == 0)
+        {
+            return false;
+        }
+
+        w.lock();
+        const bool found = !w.tasks.empty();
+        if (found)
+        {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+            w.size.store(static_cast<unsigned>(w.tasks.size()), std::memory_order_relaxed);
+        }
+        w.unlock();
+
+        return found;
+    }
+
+    // Other workers in turn, starting after the thief, skipping deques that
+    // look empty or are busy: a waiter has its barrier word to get back to.
+    bool steal(int thief, Task & task)
+    {
+        const int n = get_num_workers();
+        for (int i = 1; i < n; ++i)
+        {
+            Worker & victim = get_worker((thief + i) % n);
+
+            if (victim.size.load(std::memory_order_relaxed) == 0 || !victim.try_lock())
+            {
+                continue;
+            }
+
+            const bool found = !victim.tasks.empty();
+            if (found)
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                victim.size.store(static_cast<unsigned>(victim.tasks.size()), std::memory_order_relaxed);
+            }
+            victim.unlock();
+
+            if (found)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::vector< Worker, boost::alignment::aligned_allocator<Worker, LEVEL1_DCACHE_LINESIZE> > m_workers;
+
+    int64_t m_max_slice_ns;     // Budget of a slice
+
+    // Tasks pushed and not finished yet, queued or running.
+    alignas(LEVEL1_DCACHE_LINESIZE) std::atomic<unsigned> m_num_pending{ 0 };
+};
+
+
+// Runs tasks of the TaskPool bound to the waiting thread instead of spinning,
+// see above.
+template <class Backoff = RelaxBackoff>
+struct TaskWait
+{
+    using ParkState = WaitDetails::NoParkState;
+
+    template <class Pred, class State>
+    static WaitDetails::Word wait(std::atomic<WaitDetails::Word> & word, State &, Pred pred, unsigned hint)
+    {
+        Backoff backoff(hint);
+
+        WaitDetails::Word cur;
+        while ( !pred(cur = word.load(std::memory_order_acquire)) )
+        {
+            if (!TaskPool::run_bound())
+            {
+                backoff();
+            }
+        }
+        return cur;
+    }
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef INC_THREAD_ID_H
+#define INC_THREAD_ID_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+    Thread id sources: how a barrier of barriers.h finds out which thread of
+    the team is crossing it, when the caller does not pass the id itself.
+    A source is a type constructed with the team size by the barrier it
+    serves, with an int get() returning 0 .. team size - 1 for the calling
+    thread. It is a template parameter, so the lookup is inlined into the
+    crossing.
+
+    ExplicitThreadId        no lookup, every crossing passes the id itself:
+                            barrier(thread_id). barrier() only compiles for
+                            barriers that need no id (the counter).
+    RegisteredThreadId      handed out per barrier in order of first use:
+                            the first thread to cross gets 0, the next 1,
+                            and so on. A thread that exits gives its ids
+                            back, to the threads that replace it. More live
+                            threads than the team size crossing is an error,
+                            reported and aborted on. For std::thread and
+                            pthreads, not for OpenMP teams forked again on
+                            other OS threads.
+    OmpThreadId             omp_get_thread_num(), only with OpenMP
+
+    DefaultThreadId is the default of barriers.h and the id of the gtmp entry
+    points built on it: OmpThreadId with OpenMP, RegisteredThreadId without.
+    Override at build time with e.g. make THREAD_ID=RegisteredThreadId.
+*/
+
+struct ExplicitThreadId
+{
+    explicit ExplicitThreadId(int)
+    {
+
+    }
+
+    template <class T = void>
+    static int get()
+    {
+        static_assert(!std::is_same<T, T>::value, "ExplicitThreadId: pass the id to barrier(thread_id)");
+        return 0;
+    }
+};
+
+class RegisteredThreadId
+{
+public:
+
+    explicit RegisteredThreadId(int team_size) :
+        m_registry(std::make_shared<Registry>(team_size)),
+        m_serial(m_registry->serial)
+    {
+
+    }
+
+    RegisteredThreadId(const RegisteredThreadId &) = delete;
+    RegisteredThreadId & operator=(const RegisteredThreadId &) = delete;
+
+    int get()
+    {
+        // The barrier crossed last comes first, so a steady loop only tests one entry.
+        Entries & entries = get_entries();
+        if (!entries.empty() && entries.front().serial == m_serial)
+        {
+            return entries.front().id;
+        }
+        return lookup(entries);
+    }
+
+private:
+
+    // Shared with the threads that hold an id, which may outlive the barrier.
+    struct Registry
+    {
+        explicit Registry(int team_size) :
+            serial(next_serial().fetch_add(1, std::memory_order_relaxed))
+        {
+            for (int id = team_size - 1; id >= 0; --id)
+            {
+                free_ids.push_back(id);
+            }
+        }
+
+        const uint64_t serial;
+        std::mutex mutex;
+        std::vector<int> free_ids;      // Lowest last
+    };
+
+    struct Entry
+    {
+        uint64_t serial;
+        int id;
+        std::weak_ptr<Registry> registry;
+    };
+
+    // The ids of one thread, given back when it exits.
+    struct Entries : std::vector<Entry>
+    {
+        ~Entries()
+        {
+            for (const Entry & entry : *this)
+            {
+                give_back(entry);
+            }
+        }
+    };
+
+    static std::atomic<uint64_t> & next_serial()
+    {
+        static std::atomic<uint64_t> s_next{ 0 };
+        return s_next;
+    }
+
+    static Entries & get_entries()
+    {
+        thread_local Entries s_entries;
+        return s_entries;
+    }
+
+    static void give_back(const Entry & entry)
+    {
+        if (const std::shared_ptr<Registry> registry = entry.registry.lock())
+        {
+            std::lock_guard<std::mutex> lock(registry->mutex);
+            registry->free_ids.push_back(entry.id);
+            std::sort(registry->free_ids.begin(), registry->free_ids.end(), std::greater<int>());
+        }
+    }
+
+    // First crossing of this barrier by the calling thread, or not the last one it crossed.
+    int lookup(Entries & entries)
+    {
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->serial == m_serial)
+            {
+                std::iter_swap(entries.begin(), it);
+                return entries.front().id;
+            }
+        }
+
+        // Drop the ids of barriers that are gone.
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+            [](const Entry & entry) { return entry.registry.expired(); }), entries.end());
+
+        int id = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_registry->mutex);
+            if (!m_registry->free_ids.empty())
+            {
+                id = m_registry->free_ids.back();
+                m_registry->free_ids.pop_back();
+            }
+        }
+
+        if (id < 0)
+        {
+            std::cerr << "gtmp: more threads than the team size crossed a barrier with registered ids"
+                " (a thread keeps its id until it exits)\n";
+            std::abort();
+        }
+
+        entries.insert(entries.begin(), Entry{ m_serial, id, m_registry });
+        return id;
+    }
+
+    std::shared_ptr<Registry> m_registry;
+    uint64_t m_serial;
+};
+
+#ifdef _OPENMP
+struct OmpThreadId
+{
+    explicit OmpThreadId(int)
+    {
+
+    }
+
+    static int get()
+    {
+        return omp_get_thread_num();
+    }
+};
+#endif
+
+#ifndef GTMP_THREAD_ID
+#ifdef _OPENMP
+#define GTMP_THREAD_ID OmpThreadId
+#else
+#define GTMP_THREAD_ID RegisteredThreadId
+#endif
+#endif
+
+using DefaultThreadId = GTMP_THREAD_ID;
+
+#endif
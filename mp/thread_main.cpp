@@ -0,0 +1,251 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include <boost/numeric/conversion/cast.hpp>
+#include <boost/assert.hpp>
+#include <boost/align/aligned_allocator.hpp>
+
+#include <pthread.h>
+
+#include "barriers.h"
+#include "aligned_new.h"
+
+// Driver of the header-only barriers for a team of std::threads, built and
+// linked without OpenMP (see the Makefile), as in a service that runs its
+// own threads.
+//
+// Usage: threads [num_threads] [--iters N] [--barrier NAME]
+//
+//   NAME is counter, sharded, tree, mcs, dynamic, dissemination, tournament,
+//   adaptive, hierarchical or all (default). Each barrier is crossed with the
+//   id passed in (ExplicitThreadId) and looked up (RegisteredThreadId), and
+//   compared with pthread_barrier_wait.
+//
+//   Without OpenMP the creating thread builds every node of a barrier, so
+//   the state of all threads sits on its NUMA node (see node_arena.h).
+
+struct Args
+{
+	int num_threads = 0;
+	unsigned num_iters = 1 << 20;
+	std::string barrier = "all";
+};
+
+Args parse_args(int argc, char ** argv)
+{
+	Args args;
+
+	int iarg = 1;
+	if (iarg < argc && argv[iarg][0] != '-')
+	{
+		args.num_threads = std::stoi(argv[iarg++]);
+		BOOST_ASSERT(args.num_threads >= 1);
+	}
+	else
+	{
+		args.num_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	}
+
+	for (; iarg < argc; iarg += 2)
+	{
+		const std::string key(argv[iarg]);
+
+		if (iarg + 1 >= argc)
+		{
+			std::cerr << "Missing value for option " + key + "\n";
+			std::exit(1);
+		}
+
+		const std::string val(argv[iarg + 1]);
+
+		if (key == "--iters")
+		{
+			args.num_iters = boost::numeric_cast<unsigned>(std::stoul(val));
+		}
+		else if (key == "--barrier")
+		{
+			args.barrier = val;
+		}
+		else
+		{
+			std::cerr << "Unknown option " + key + "\n";
+			std::exit(1);
+		}
+	}
+
+	std::cout << "Number of threads is " + std::to_string(args.num_threads) + "\n";
+
+	// Without OpenMP, node_arena.h has no team to place the barrier state
+	// with: it all sits on the node of the thread that creates the barrier.
+	std::cout << "Barrier state is built by the creating thread, on its NUMA node, "
+		"so on a multi-node machine they are compared with pthread_barrier_wait in a non-local layout\n";
+
+	return args;
+}
+
+// Starts a team of std::threads that each call crossing(thread_id): first an
+// untimed check, as check_barrier() of main.cpp does, then num_iters timed
+// crossings. Returns the seconds of the slowest thread.
+template <class Crossing>
+double run_team(int num_threads, unsigned num_iters, Crossing crossing)
+{
+	struct alignas(LEVEL1_DCACHE_LINESIZE) Slot
+	{
+		std::atomic<unsigned> count{ 0 };
+		double seconds = 0;
+	};
+
+	std::vector< Slot, boost::alignment::aligned_allocator<Slot, LEVEL1_DCACHE_LINESIZE> > slots(num_threads);
+	const unsigned num_check = std::min(num_iters, 1000u);
+
+	std::vector<std::thread> team;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		team.emplace_back([&slots, &crossing, num_threads, num_iters, num_check, t]
+		{
+			for (unsigned i = 0; i < num_check; ++i)
+			{
+				const unsigned mine = slots[t].count.fetch_add(1, std::memory_order_relaxed) + 1;
+
+				crossing(t);
+
+				if (t < num_threads - 1)
+				{
+					const unsigned next = slots[t + 1].count.load(std::memory_order_relaxed);
+					BOOST_ASSERT(next == mine || next == mine + 1);
+					(void)next;
+				}
+			}
+
+			const auto start = std::chrono::steady_clock::now();
+			for (unsigned i = 0; i < num_iters; ++i)
+			{
+				crossing(t);
+			}
+			slots[t].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		});
+	}
+
+	double seconds = 0;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		team[t].join();
+		seconds = std::max(seconds, slots[t].seconds);
+	}
+	return seconds;
+}
+
+double run_pthread(const Args & args)
+{
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, nullptr, unsigned(args.num_threads));
+
+	const double seconds = run_team(args.num_threads, args.num_iters, [&barrier](int)
+	{
+		pthread_barrier_wait(&barrier);
+	});
+
+	pthread_barrier_destroy(&barrier);
+
+	return seconds;
+}
+
+template <template <class, class, class> class Barrier>
+void run_barrier(const Args & args, const std::string & name, double pthread_seconds)
+{
+	using ExplicitBarrier = Barrier<DefaultWaitPolicy, EnvLayout, ExplicitThreadId>;
+	using RegisteredBarrier = Barrier<DefaultWaitPolicy, EnvLayout, RegisteredThreadId>;
+
+	ExplicitBarrier * explicit_barrier = aligned_new<ExplicitBarrier>(args.num_threads);
+	const double explicit_seconds = run_team(args.num_threads, args.num_iters, [explicit_barrier](int thread_id)
+	{
+		explicit_barrier->barrier(thread_id);
+	});
+	aligned_delete(explicit_barrier);
+
+	RegisteredBarrier * registered_barrier = aligned_new<RegisteredBarrier>(args.num_threads);
+	const double registered_seconds = run_team(args.num_threads, args.num_iters, [registered_barrier](int)
+	{
+		registered_barrier->barrier();
+	});
+	aligned_delete(registered_barrier);
+
+	const double explicit_ns = explicit_seconds * 1e9 / args.num_iters;
+	const double registered_ns = registered_seconds * 1e9 / args.num_iters;
+	const double pthread_ns = pthread_seconds * 1e9 / args.num_iters;
+
+	std::cout << name + ": " + std::to_string(explicit_ns) + "ns with the id passed in, " + std::to_string(registered_ns)
+		+ "ns with a registered id per crossing (" + std::to_string(explicit_ns / pthread_ns) + "x, "
+		+ std::to_string(registered_ns / pthread_ns) + "x pthread_barrier_wait)\n";
+}
+
+int main(int argc, char ** argv)
+{
+	const Args args = parse_args(argc, argv);
+	const bool all = args.barrier == "all";
+
+	const double pthread_seconds = run_pthread(args);
+	std::cout << "pthread_barrier_wait: " + std::to_string(pthread_seconds * 1e9 / args.num_iters) + "ns per crossing\n";
+
+	bool found = all;
+
+	if (all || args.barrier == "counter")
+	{
+		run_barrier<CounterTeamBarrier>(args, "counter", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "sharded")
+	{
+		run_barrier<ShardedTeamBarrier>(args, "sharded", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "tree")
+	{
+		run_barrier<CombiningTeamBarrier>(args, "tree", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "mcs")
+	{
+		run_barrier<McsTeamBarrier>(args, "mcs", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "dynamic")
+	{
+		run_barrier<DynamicTeamBarrier>(args, "dynamic", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "dissemination")
+	{
+		run_barrier<DisseminationTeamBarrier>(args, "dissemination", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "tournament")
+	{
+		run_barrier<TournamentTeamBarrier>(args, "tournament", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "adaptive")
+	{
+		run_barrier<AdaptiveTeamBarrier>(args, "adaptive", pthread_seconds);
+		found = true;
+	}
+	if (all || args.barrier == "hierarchical")
+	{
+		run_barrier<HierarchicalTeamBarrier>(args, "hierarchical", pthread_seconds);
+		found = true;
+	}
+
+	if (!found)
+	{
+		std::cerr << "No barrier " + args.barrier + " in barriers.h\n";
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,255 @@
+#ifndef INC_TOURNAMENT_BARRIER_H
+#define INC_TOURNAMENT_BARRIER_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+#include <boost/assert.hpp>
+
+#include "wait_policy.h"
+#include "node_arena.h"
+
+/*
+    From the MCS Paper: A scalable, distributed tournament barrier with only local spinning
+
+    type round_t = record
+        role : (winner, loser, bye, champion, dropout)
+        opponent : ^Boolean
+        flag : Boolean
+    shared rounds : array [0..P-1][0..LogP] of round_t
+        // row vpid of rounds is allocated in shared memory
+        // locally accessible to processor vpid
+
+    processor private sense : Boolean := true
+    processor private vpid : integer // a unique virtual processor index
+
+    //initially
+    //    rounds[i][k].flag = false for all i,k
+    //rounds[i][k].role =
+    //    winner if k > 0, i mod 2^k = 0, i + 2^(k-1) < P , and 2^k < P
+    //    bye if k > 0, i mode 2^k = 0, and i + 2^(k-1) >= P
+    //    loser if k > 0 and i mode 2^k = 2^(k-1)
+    //    champion if k > 0, i = 0, and 2^k >= P
+    //    dropout if k = 0
+    //    unused otherwise; value immaterial
+    //rounds[i][k].opponent points to
+    //    round[i-2^(k-1)][k].flag if rounds[i][k].role = loser
+    //    round[i+2^(k-1)][k].flag if rounds[i][k].role = winner or champion
+    //    unused otherwise; value immaterial
+    procedure tournament_barrier
+        round : integer := 1
+        loop   //arrival
+            case rounds[vpid][round].role of
+                loser:
+                    rounds[vpid][round].opponent^ :=  sense
+                    repeat until rounds[vpid][round].flag = sense
+                    exit loop
+                winner:
+                    repeat until rounds[vpid][round].flag = sense
+                bye:  //do nothing
+                champion:
+                    repeat until rounds[vpid][round].flag = sense
+                    rounds[vpid][round].opponent^ := sense
+                    exit loop
+                dropout: // impossible
+            round := round + 1
+        loop  // wakeup
+            round := round - 1
+            case rounds[vpid][round].role of
+                loser: // impossible
+                winner:
+                    rounds[vpid[round].opponent^ := sense
+                bye: // do nothing
+                champion: // impossible
+                dropout:
+                    exit loop
+        sense := not sense
+*/
+
+
+template <class WaitPolicy = DefaultWaitPolicy, class Layout = EnvLayout>
+class TournamentBarrier
+{
+    using Flag = WaitWord<WaitPolicy>;
+
+public:
+
+    // Enough rounds for 2^16 threads. Round 0 is the dropout round.
+    static constexpr unsigned kMaxRounds = 16;
+
+    TournamentBarrier() = default;
+
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        const unsigned num_nodes = static_cast<unsigned>(num_threads);
+
+        unsigned num_rounds = 0;
+        while ((1u << num_rounds) < num_nodes)
+        {
+            ++num_rounds;
+        }
+        BOOST_ASSERT(num_rounds <= kMaxRounds);
+
+        // Node i is placed near thread i, opponent pointers are filled in below.
+        m_nodes.create(num_nodes, num_threads,
+            [](size_t i) { return static_cast<int>(i); },
+            [](size_t, void * mem) { new (mem) Node(); });
+
+        for (unsigned i = 0; i < num_nodes; ++i)
+        {
+            Private & me = m_nodes[i].priv;
+
+            me.sense = 1;
+            me.role[0] = Role::Dropout;
+
+            for (unsigned k = 1; k <= num_rounds; ++k)
+            {
+                const unsigned span = 1u << k;
+                const unsigned half = span >> 1;
+
+                Role role = Role::Unused;
+                Flag * opponent = nullptr;
+
+                if (i == 0 && span >= num_nodes)
+                {
+                    role = Role::Champion;
+                    opponent = &(m_nodes[i + half].flags.flag[k]);
+                }
+                else if (i % span == 0 && i + half < num_nodes)
+                {
+                    role = Role::Winner;
+                    opponent = &(m_nodes[i + half].flags.flag[k]);
+                }
+                else if (i % span == 0)
+                {
+                    role = Role::Bye;
+                }
+                else if (i % span == half)
+                {
+                    role = Role::Loser;
+                    opponent = &(m_nodes[i - half].flags.flag[k]);
+                }
+
+                me.role[k] = role;
+                me.opponent[k] = opponent;
+            }
+        }
+    }
+
+    void barrier(int thread_id)
+    {
+        BOOST_ASSERT(thread_id >= 0);
+        BOOST_ASSERT(static_cast<size_t>(thread_id) < m_nodes.size());
+
+        Node & node = m_nodes[static_cast<size_t>(thread_id)];
+        Private & me = node.priv;
+        Flag * flags = node.flags.flag;
+        const auto sense = me.sense;
+
+        // A team of one has no rounds at all.
+        if (m_nodes.size() == 1)
+        {
+            return;
+        }
+
+        // Arrival: climb until this thread loses a match or becomes the champion.
+        unsigned round = 1;
+        for (bool done = false; !done; )
+        {
+            switch (me.role[round])
+            {
+            case Role::Loser:
+                me.opponent[round]->store(sense);
+                flags[round].wait_until_equal(sense);
+                done = true;
+                break;
+
+            case Role::Winner:
+                flags[round].wait_until_equal(sense);
+                ++round;
+                break;
+
+            case Role::Bye:
+                ++round;
+                break;
+
+            case Role::Champion:
+                flags[round].wait_until_equal(sense);
+                me.opponent[round]->store(sense);
+                done = true;
+                break;
+
+            default:
+                BOOST_ASSERT_MSG(false, "Impossible role during arrival");
+                done = true;
+                break;
+            }
+        }
+
+        // Wakeup: walk the arrival path back down, releasing every loser beaten on the way up.
+        for (bool done = false; !done; )
+        {
+            --round;
+
+            switch (me.role[round])
+            {
+            case Role::Winner:
+                me.opponent[round]->store(sense);
+                break;
+
+            case Role::Bye:
+                break;
+
+            case Role::Dropout:
+                done = true;
+                break;
+
+            default:
+                BOOST_ASSERT_MSG(false, "Impossible role during wakeup");
+                done = true;
+                break;
+            }
+        }
+
+        me.sense = !sense;
+    }
+
+private:
+
+    enum class Role : uint8_t
+    {
+        Unused,
+        Winner,
+        Loser,
+        Bye,
+        Champion,
+        Dropout
+    };
+
+    // Role table, computed once in init and only read by the owning thread.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Private
+    {
+        Role role[kMaxRounds + 1] = {};
+        Flag * opponent[kMaxRounds + 1] = {};
+        typename Flag::Word sense = 1;
+    };
+
+    // rounds[vpid][*].flag: spun on by the owner, written by its opponent of that round.
+    struct alignas(LEVEL1_DCACHE_LINESIZE) Flags
+    {
+        Flag flag[kMaxRounds + 1];
+    };
+
+    struct Node
+    {
+        Private priv;
+        Flags flags;
+    };
+
+    ArenaArray<Node, Layout> m_nodes;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef INC_TSC_CLOCK_H
+#define INC_TSC_CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timestamps from the TSC, calibrated once against steady_clock. They are
+// compared across threads, which assumes an invariant TSC synchronized
+// between cores (any x86 of the last decade). Elsewhere steady_clock is used.
+
+namespace TscDetails
+{
+	inline uint64_t read_steady_ns()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	inline double calibrate_ns_per_tick();
+}
+
+class TscClock
+{
+public:
+
+	// The lfence keeps rdtsc from being executed ahead of the loads and
+	// stores before it, e.g. the last poll of the barrier.
+	static uint64_t now()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		_mm_lfence();
+		return __rdtsc();
+#else
+		return TscDetails::read_steady_ns();
+#endif
+	}
+
+	static double get_ns_per_tick()
+	{
+		static const double ns_per_tick = TscDetails::calibrate_ns_per_tick();
+		return ns_per_tick;
+	}
+
+	static double to_ns(uint64_t ticks)
+	{
+		return double(ticks) * get_ns_per_tick();
+	}
+};
+
+inline double TscDetails::calibrate_ns_per_tick()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	const uint64_t ns0 = read_steady_ns();
+	const uint64_t tick0 = TscClock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	const uint64_t ns1 = read_steady_ns();
+	const uint64_t tick1 = TscClock::now();
+
+	return double(ns1 - ns0) / double(tick1 - tick0);
+#else
+	return 1.0;
+#endif
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef INC_TUNED_MCS_TREE_H
+#define INC_TUNED_MCS_TREE_H
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include <omp.h>
+
+#include <boost/assert.hpp>
+#include <boost/variant.hpp>
+
+#include "mcs_tree.h"
+#include "verbose.h"
+
+// An MCS tree whose arrival and wakeup fan-out are picked at init time.
+//
+// Every configuration of the grid is a separate GenericMcsTree instantiation
+// held in a variant, so that the hot path dispatches with a switch on the
+// active type rather than through a virtual call, and each tree keeps its
+// fan-outs as compile time constants.
+//
+// init() times a short run of barriers of every configuration on the live
+// team and keeps the fastest. Each run stops after GTMP_MCS_CALIB_ITERS
+// barriers (default 500) or GTMP_MCS_CALIB_US microseconds (default 2000),
+// whichever comes first, or as soon as it is clearly slower than the best
+// so far. The choice is remembered per team size, so only the first tree
+// of a size pays for it. GTMP_MCS_CONFIG=<ArriveK>x<WakeupK> (e.g. 8x2)
+// skips the calibration.
+template <class... Trees>
+class GenericTunedMcsTree
+{
+    using Variant = boost::variant<Trees...>;
+
+public:
+
+    using Token = typename std::tuple_element< 0, std::tuple<Trees...> >::type::Token;
+
+    static constexpr unsigned kNumConfigs = sizeof...(Trees);
+    static constexpr unsigned kDefaultCalibIters = 500;
+    static constexpr unsigned kDefaultCalibUs = 2000;
+    static constexpr unsigned kWarmupIters = 8;
+    static constexpr unsigned kMaxBatch = 64;
+
+    // A run stops once its time per barrier is this many times the best one.
+    static constexpr double kGiveUpRatio = 1.5;
+
+    struct Config
+    {
+        unsigned arrive_k;
+        unsigned wakeup_k;
+    };
+
+    GenericTunedMcsTree() = default;
+
+    // Must be called outside of any parallel region, the calibration runs its own.
+    void init(int num_threads)
+    {
+        BOOST_ASSERT(num_threads > 0);
+
+        unsigned iconfig = kNumConfigs;
+        std::string how;
+
+        if (parse_forced_config(iconfig))
+        {
+            how = "forced by GTMP_MCS_CONFIG";
+        }
+        else if (find_calibrated(num_threads, iconfig))
+        {
+            how = "calibrated earlier for this team size";
+        }
+        else
+        {
+            std::ostringstream oss;
+            const double seconds = calibrate(num_threads, iconfig);
+
+            if (seconds < std::numeric_limits<double>::infinity())
+            {
+                oss << "calibrated, " << seconds * 1e9 << "ns per barrier";
+                remember_calibrated(num_threads, iconfig);
+            }
+            else
+            {
+                // e.g. created inside a parallel region with nesting disabled
+                find_config(McsTree::kArriveK, McsTree::kWakeupK, iconfig);
+                oss << "default, could not get a team of " << num_threads << " to calibrate";
+            }
+            how = oss.str();
+        }
+
+        select(iconfig);
+        init_selected(num_threads);
+
+        print_verbose("gtmp mcs: ArriveK=" + std::to_string(get_configs()[iconfig].arrive_k)
+            + " WakeupK=" + std::to_string(get_configs()[iconfig].wakeup_k) + " (" + how + ")\n");
+    }
+
+    void barrier(int omp_thread_num)
+    {
+        boost::apply_visitor([omp_thread_num](auto & tree) { tree.barrier(omp_thread_num); }, m_tree);
+    }
+
+    Token arrive(int omp_thread_num)
+    {
+        return boost::apply_visitor([omp_thread_num](auto & tree) { return tree.arrive(omp_thread_num); }, m_tree);
+    }
+
+    void wait(int omp_thread_num, Token episode)
+    {
+        boost::apply_visitor([omp_thread_num, episode](auto & tree) { tree.wait(omp_thread_num, episode); }, m_tree);
+    }
+
+    bool test(int omp_thread_num, Token episode)
+    {
+        return boost::apply_visitor([omp_thread_num, episode](auto & tree) { return tree.test(omp_thread_num, episode); }, m_tree);
+    }
+
+    template <class T, class Op>
+    T barrier_reduce(int omp_thread_num, const T & value, Op op)
+    {
+        return boost::apply_visitor([omp_thread_num, &value, op](auto & tree)
+        {
+            return tree.barrier_reduce(omp_thread_num, value, op);
+        }, m_tree);
+    }
+
+    const Config & get_config() const
+    {
+        return get_configs()[m_tree.which()];
+    }
+
+    static const Config * get_configs()
+    {
+        static const Config configs[] = { { Trees::kArriveK, Trees::kWakeupK }... };
+        return configs;
+    }
+
+private:
+
+    // Makes configuration iconfig the active one. Its tree still has to be init'ed.
+    void select(unsigned iconfig)
+    {
+        using Maker = void (*)(Variant &);
+        static const Maker makers[] = { &make<Trees>... };
+
+        BOOST_ASSERT(iconfig < kNumConfigs);
+        makers[iconfig](m_tree);
+    }
+
+    template <class Tree>
+    static void make(Variant & tree)
+    {
+        tree = Tree();
+    }
+
+    void init_selected(int num_threads)
+    {
+        boost::apply_visitor([num_threads](auto & tree) { tree.init(num_threads); }, m_tree);
+    }
+
+    static bool parse_forced_config(unsigned & iconfig)
+    {
+        const char * env = std::getenv("GTMP_MCS_CONFIG");
+        if (!env)
+        {
+            return false;
+        }
+
+        unsigned arrive_k = 0;
+        unsigned wakeup_k = 0;
+        char x = 0;
+        std::istringstream iss(env);
+
+        if ((iss >> arrive_k >> x >> wakeup_k) && x == 'x' && find_config(arrive_k, wakeup_k, iconfig))
+        {
+            return true;
+        }
+
+        std::string known;
+        for (unsigned i = 0; i < kNumConfigs; ++i)
+        {
+            known += " " + std::to_string(get_configs()[i].arrive_k) + "x" + std::to_string(get_configs()[i].wakeup_k);
+        }
+        std::cerr << "gtmp: ignoring GTMP_MCS_CONFIG=\"" + std::string(env) + "\", known configurations are" + known + "\n";
+        return false;
+    }
+
+    static bool find_config(unsigned arrive_k, unsigned wakeup_k, unsigned & iconfig)
+    {
+        for (unsigned i = 0; i < kNumConfigs; ++i)
+        {
+            if (get_configs()[i].arrive_k == arrive_k && get_configs()[i].wakeup_k == wakeup_k)
+            {
+                iconfig = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static unsigned read_env_unsigned(const char * name, unsigned fallback)
+    {
+        const char * env = std::getenv(name);
+        if (!env)
+        {
+            return fallback;
+        }
+        return static_cast<unsigned>(std::max(1, std::atoi(env)));
+    }
+
+    // Calibrated choices by team size, shared by all the trees of the process.
+    static std::map<int, unsigned> & get_calibrated()
+    {
+        static std::map<int, unsigned> calibrated;
+        return calibrated;
+    }
+
+    static std::mutex & get_calibrated_mutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static bool find_calibrated(int num_threads, unsigned & iconfig)
+    {
+        std::lock_guard<std::mutex> lock(get_calibrated_mutex());
+
+        const auto it = get_calibrated().find(num_threads);
+        if (it == get_calibrated().end())
+        {
+            return false;
+        }
+        iconfig = it->second;
+        return true;
+    }
+
+    static void remember_calibrated(int num_threads, unsigned iconfig)
+    {
+        std::lock_guard<std::mutex> lock(get_calibrated_mutex());
+        get_calibrated()[num_threads] = iconfig;
+    }
+
+    // Picks the fastest configuration into iconfig and returns its seconds per
+    // barrier, or infinity if no full team could be started.
+    double calibrate(int num_threads, unsigned & iconfig)
+    {
+        const unsigned iters = read_env_unsigned("GTMP_MCS_CALIB_ITERS", kDefaultCalibIters);
+        const double budget = read_env_unsigned("GTMP_MCS_CALIB_US", kDefaultCalibUs) * 1e-6;
+        const unsigned max_k = static_cast<unsigned>(std::max(num_threads - 1, 1));
+
+        // Fan-outs above P-1 all give the same tree, time each distinct shape once.
+        std::vector<Config> measured;
+
+        double best = std::numeric_limits<double>::infinity();
+        iconfig = 0;
+
+        for (unsigned i = 0; i < kNumConfigs; ++i)
+        {
+            const Config shape = { std::min(get_configs()[i].arrive_k, max_k), std::min(get_configs()[i].wakeup_k, max_k) };
+
+            auto same_shape = [&shape](const Config & c) { return c.arrive_k == shape.arrive_k && c.wakeup_k == shape.wakeup_k; };
+            if (std::any_of(measured.begin(), measured.end(), same_shape))
+            {
+                continue;
+            }
+            measured.push_back(shape);
+
+            select(i);
+            init_selected(num_threads);
+
+            const double seconds = time_barriers(num_threads, iters, budget, best);
+            if (seconds < best)
+            {
+                best = seconds;
+                iconfig = i;
+            }
+        }
+
+        return best;
+    }
+
+    // Seconds per barrier of the selected configuration, or infinity if no
+    // full team could be started. Barriers run in batches of doubling size:
+    // after each one, thread 0 decides whether to stop (iters barriers done,
+    // budget seconds spent, or slower than best by kGiveUpRatio), and one
+    // more barrier hands the decision to the others, so that all threads
+    // cross the same number of times.
+    double time_barriers(int num_threads, unsigned iters, double budget, double best)
+    {
+        double per_barrier = std::numeric_limits<double>::infinity();
+        std::atomic<bool> stop{ false };
+
+        #pragma omp parallel num_threads(num_threads)
+        if (omp_get_num_threads() == num_threads)
+        {
+            const int thread_id = omp_get_thread_num();
+
+            for (unsigned i = 0; i < kWarmupIters; ++i)
+            {
+                barrier(thread_id);
+            }
+
+            const double start = omp_get_wtime();
+            unsigned done = 0;
+
+            for (unsigned batch = 1; ; batch = std::min(2 * batch, kMaxBatch))
+            {
+                for (unsigned i = 0; i < batch; ++i)
+                {
+                    barrier(thread_id);
+                }
+                done += batch;
+
+                if (thread_id == 0)
+                {
+                    const double elapsed = omp_get_wtime() - start;
+                    per_barrier = elapsed / done;
+                    stop.store(done >= iters || elapsed >= budget || per_barrier > best * kGiveUpRatio,
+                        std::memory_order_relaxed);
+                }
+
+                // Counted with the next batch.
+                barrier(thread_id);
+                ++done;
+
+                if (stop.load(std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+        }
+
+        return per_barrier;
+    }
+
+    Variant m_tree;
+};
+
+
+// ArriveK in {2, 4, 8, 16, 32} by WakeupK in {1, 2, 4, 8}
+using TunedMcsTree = GenericTunedMcsTree<
+    GenericMcsTree< 2, 1>, GenericMcsTree< 2, 2>, GenericMcsTree< 2, 4>, GenericMcsTree< 2, 8>,
+    GenericMcsTree< 4, 1>, GenericMcsTree< 4, 2>, GenericMcsTree< 4, 4>, GenericMcsTree< 4, 8>,
+    GenericMcsTree< 8, 1>, GenericMcsTree< 8, 2>, GenericMcsTree< 8, 4>, GenericMcsTree< 8, 8>,
+    GenericMcsTree<16, 1>, GenericMcsTree<16, 2>, GenericMcsTree<16, 4>, GenericMcsTree<16, 8>,
+    GenericMcsTree<32, 1>, GenericMcsTree<32, 2>, GenericMcsTree<32, 4>, GenericMcsTree<32, 8> >;
+
+#endif
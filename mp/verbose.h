@@ -0,0 +1,28 @@
+#ifndef INC_VERBOSE_H
+#define INC_VERBOSE_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// The barriers are a library: they only write their configuration and
+// statistics to stdout when GTMP_VERBOSE is set to a non-zero number.
+inline bool is_verbose()
+{
+    static const bool verbose = []
+    {
+        const char * env = std::getenv("GTMP_VERBOSE");
+        return env && std::atoi(env) != 0;
+    }();
+    return verbose;
+}
+
+inline void print_verbose(const std::string & text)
+{
+    if (is_verbose())
+    {
+        std::cout << text;
+    }
+}
+
+#endif
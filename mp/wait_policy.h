@@ -0,0 +1,446 @@
+#ifndef INC_WAIT_POLICY_H
+#define INC_WAIT_POLICY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/*
+    Wait policies decide what a thread does while it waits for a barrier word
+    to change. All gtmp barriers spin through WaitWord<Policy> so that the
+    policy can be swapped per barrier instance without touching the algorithm.
+
+    BackoffSpinWait<B>   Busy spin, with backoff policy B after every failed poll.
+    SpinWait             BackoffSpinWait<NoBackoff>, the original behaviour.
+    PauseWait            BackoffSpinWait<RelaxBackoff>.
+    SpinThenFutexWait<N, B>
+                         Spin N polls with backoff B, then sleep in the kernel.
+    AdaptiveWait         Spin for a time budget learned from previous waits,
+                         then sleep in the kernel.
+    TaskWait<B>          Run slices of queued low priority tasks between polls,
+                         back off with B when there are none, see task_pool.h.
+    ProcessSharedWait<P> Policy P for words in memory shared between processes
+                         (see shm_barriers.h): sleepers can be woken up from
+                         another process, wherever it maps the word.
+
+    Sleeping policies count the waiters that are parked on a word, so the
+    releasing thread only pays for a wake-up syscall when somebody is asleep.
+
+    Backoff policies decide how long a spinning thread stays off the line
+    after a failed poll, leaving the line to the threads that still have to
+    write it and the core to an SMT sibling:
+
+    NoBackoff            Poll again right away.
+    RelaxBackoff         One pause instruction.
+    ExpBackoff<Min, Max> Min pauses, doubling after every failed poll up to Max.
+    ProportionalBackoff<N>
+                         N pauses per arrival still expected, halving after
+                         every failed poll. Barriers that know the number of
+                         expected arrivals (the counter) pass it as a hint,
+                         the others pass 0, which counts as 1.
+*/
+
+namespace WaitDetails
+{
+    using Word = uint32_t;
+
+    static_assert(sizeof(std::atomic<Word>) == sizeof(Word), "Futex needs a plain 32-bit word");
+
+    inline void cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield" ::: "memory");
+#else
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+    // Sleep while the word still holds expected. Spurious returns are fine,
+    // callers always re-check their condition. Private futexes are cheaper,
+    // but only found by wakers of the same process.
+    template <bool kProcessShared = false>
+    inline void park(std::atomic<Word> & word, Word expected)
+    {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<Word *>(&word), kProcessShared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE,
+                expected, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+        word.wait(expected);
+#else
+        (void)word;
+        (void)expected;
+        std::this_thread::yield();
+#endif
+    }
+
+    inline void relax_for(unsigned num_pauses)
+    {
+        for (unsigned i = 0; i < num_pauses; ++i)
+        {
+            cpu_relax();
+        }
+    }
+
+    template <bool kProcessShared = false>
+    inline void unpark_all(std::atomic<Word> & word)
+    {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<Word *>(&word), kProcessShared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE,
+                INT_MAX, nullptr, nullptr, 0);
+#elif defined(__cpp_lib_atomic_wait)
+        word.notify_all();
+#else
+        (void)word;
+#endif
+    }
+
+    // Book-keeping for policies that never sleep. Empty, so WaitWord stays one word.
+    struct NoParkState
+    {
+        void notify(std::atomic<Word> &) {}
+    };
+
+    // Book-keeping for policies that may sleep.
+    template <bool kProcessShared>
+    class BasicParkState
+    {
+    public:
+        BasicParkState() :
+            m_num_parked(0)
+        {}
+
+        BasicParkState(const BasicParkState &) :
+            m_num_parked(0)
+        {}
+
+        BasicParkState & operator=(const BasicParkState &)
+        {
+            return *this;
+        }
+
+        // The sleeper's seq_cst increment and the waker's fence between its
+        // store and its load: either the waker sees the parked count, or the
+        // sleeper's futex compare sees the new value.
+        void park(std::atomic<Word> & word, Word expected)
+        {
+            m_num_parked.fetch_add(1);
+            WaitDetails::park<kProcessShared>(word, expected);
+            m_num_parked.fetch_sub(1);
+        }
+
+        void notify(std::atomic<Word> & word)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_num_parked.load(std::memory_order_relaxed) != 0)
+            {
+                unpark_all<kProcessShared>(word);
+            }
+        }
+
+    private:
+        std::atomic<Word> m_num_parked;
+    };
+
+    using ParkState = BasicParkState<false>;
+
+    // The book-keeping of a policy, for words shared between processes.
+    template <class State>
+    struct ProcessShared
+    {
+        using type = State;     // NoParkState: nothing to share
+    };
+
+    template <bool kProcessShared>
+    struct ProcessShared< BasicParkState<kProcessShared> >
+    {
+        using type = BasicParkState<true>;
+    };
+}
+
+
+// Backoff policies: constructed at the start of a wait with the hint, then
+// called after every poll that did not satisfy the waiter.
+struct NoBackoff
+{
+    explicit NoBackoff(unsigned) {}
+
+    void operator()() {}
+};
+
+
+struct RelaxBackoff
+{
+    explicit RelaxBackoff(unsigned) {}
+
+    void operator()()
+    {
+        WaitDetails::cpu_relax();
+    }
+};
+
+
+template <unsigned kMinPauses = 1, unsigned kMaxPauses = 1024>
+struct ExpBackoff
+{
+    static_assert(0 < kMinPauses && kMinPauses <= kMaxPauses, "");
+
+    explicit ExpBackoff(unsigned) {}
+
+    void operator()()
+    {
+        WaitDetails::relax_for(m_pauses);
+        m_pauses = std::min(2 * m_pauses, kMaxPauses);
+    }
+
+private:
+    unsigned m_pauses = kMinPauses;
+};
+
+
+// From the MCS paper: a thread waiting at a counter barrier can stay away for
+// a time proportional to the number of arrivals still to come, since the
+// barrier cannot complete before they all updated the count.
+template <unsigned kPausesPerArrival = 64>
+struct ProportionalBackoff
+{
+    explicit ProportionalBackoff(unsigned num_expected_arrivals) :
+        m_pauses( std::max(num_expected_arrivals, 1u) * kPausesPerArrival )
+    {}
+
+    void operator()()
+    {
+        WaitDetails::relax_for(m_pauses);
+        m_pauses = std::max(m_pauses / 2, 1u);
+    }
+
+private:
+    unsigned m_pauses;
+};
+
+
+template <class Backoff>
+struct BackoffSpinWait
+{
+    using ParkState = WaitDetails::NoParkState;
+
+    template <class Pred>
+    static WaitDetails::Word wait(std::atomic<WaitDetails::Word> & word, ParkState &, Pred pred, unsigned hint)
+    {
+        Backoff backoff(hint);
+
+        WaitDetails::Word cur;
+        while ( !pred(cur = word.load(std::memory_order_acquire)) )
+        {
+            backoff();
+        }
+        return cur;
+    }
+};
+
+
+using SpinWait = BackoffSpinWait<NoBackoff>;
+using PauseWait = BackoffSpinWait<RelaxBackoff>;
+
+
+template <unsigned kSpins = (1u << 12), class Backoff = RelaxBackoff>
+struct SpinThenFutexWait
+{
+    using ParkState = WaitDetails::ParkState;
+
+    template <class Pred, class State>
+    static WaitDetails::Word wait(std::atomic<WaitDetails::Word> & word, State & park_state, Pred pred, unsigned hint)
+    {
+        Backoff backoff(hint);
+
+        WaitDetails::Word cur = word.load(std::memory_order_acquire);
+
+        for (unsigned i = 0; i < kSpins; ++i)
+        {
+            if (pred(cur))
+            {
+                return cur;
+            }
+            backoff();
+            cur = word.load(std::memory_order_acquire);
+        }
+
+        while ( !pred(cur) )
+        {
+            park_state.park(word, cur);
+            cur = word.load(std::memory_order_acquire);
+        }
+
+        return cur;
+    }
+};
+
+
+// Spins for as long as waits recently took, so a thread only sleeps when the
+// other arrivals are genuinely late (oversubscription, preempted stragglers).
+// The budget is kept per thread, and moves towards twice the observed wait
+// when spinning succeeds, and is halved every time the thread had to sleep.
+struct AdaptiveWait
+{
+    using ParkState = WaitDetails::ParkState;
+
+    static constexpr int64_t kMinBudgetNs = 1000;
+    static constexpr int64_t kMaxBudgetNs = 200000;
+    static constexpr unsigned kSpinsPerClockRead = 64;
+
+    template <class Pred, class State>
+    static WaitDetails::Word wait(std::atomic<WaitDetails::Word> & word, State & park_state, Pred pred, unsigned)
+    {
+        thread_local int64_t s_budget_ns = 20000;
+
+        WaitDetails::Word cur = word.load(std::memory_order_acquire);
+        if (pred(cur))
+        {
+            return cur;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        int64_t elapsed_ns = 0;
+
+        while (elapsed_ns < s_budget_ns)
+        {
+            for (unsigned i = 0; i < kSpinsPerClockRead; ++i)
+            {
+                WaitDetails::cpu_relax();
+                cur = word.load(std::memory_order_acquire);
+                if (pred(cur))
+                {
+                    elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                    s_budget_ns += (std::min(2 * elapsed_ns, kMaxBudgetNs) - s_budget_ns) / 8;
+                    s_budget_ns = std::max(s_budget_ns, kMinBudgetNs);
+                    return cur;
+                }
+            }
+
+            elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        s_budget_ns = std::max(s_budget_ns / 2, kMinBudgetNs);
+
+        while ( !pred(cur) )
+        {
+            park_state.park(word, cur);
+            cur = word.load(std::memory_order_acquire);
+        }
+
+        return cur;
+    }
+};
+
+
+// Same waits as WaitPolicy, with its sleepers parked where other processes
+// can wake them up. The word must then be in shared memory, and so must
+// the WaitWord around it with its count of sleepers.
+template <class WaitPolicy>
+struct ProcessSharedWait : WaitPolicy
+{
+    using ParkState = typename WaitDetails::ProcessShared<typename WaitPolicy::ParkState>::type;
+};
+
+
+// A 32-bit barrier word that threads can wait on under a wait policy.
+// Every write that may satisfy a waiter must go through store() or be
+// followed by notify(), so that parked waiters get woken up.
+//
+// store() is a release and waits and load() are acquires: a thread that
+// sees a value sees everything the storing thread wrote before, and what
+// that thread had seen in turn. That is all a barrier needs, seq_cst would
+// only add a fence to every store on the release path.
+template <class WaitPolicy>
+class WaitWord : private WaitPolicy::ParkState
+{
+    using ParkState = typename WaitPolicy::ParkState;
+
+public:
+    using Word = WaitDetails::Word;
+
+    explicit WaitWord(Word val = 0) :
+        m_word(val)
+    {}
+
+    WaitWord(const WaitWord & other) :
+        ParkState(),
+        m_word(other.m_word.load())
+    {}
+
+    WaitWord & operator=(const WaitWord & other)
+    {
+        m_word.store(other.m_word.load());
+        return *this;
+    }
+
+    // Relaxed is enough where a barrier reads its own word only to compute
+    // the next episode.
+    Word load(std::memory_order order = std::memory_order_acquire) const
+    {
+        return m_word.load(order);
+    }
+
+    void store(Word val)
+    {
+        m_word.store(val, std::memory_order_release);
+        notify();
+    }
+
+    void notify()
+    {
+        ParkState::notify(m_word);
+    }
+
+    std::atomic<Word> & raw()
+    {
+        return m_word;
+    }
+
+    // Blocks until pred(value) holds, returns the value that satisfied it.
+    // hint is the number of arrivals the barrier still expects, 0 if unknown.
+    template <class Pred>
+    Word wait_until(Pred pred, unsigned hint = 0)
+    {
+        return WaitPolicy::wait(m_word, static_cast<ParkState &>(*this), pred, hint);
+    }
+
+    Word wait_while_equal(Word val)
+    {
+        return wait_until([val](Word cur) { return cur != val; });
+    }
+
+    Word wait_until_equal(Word val)
+    {
+        return wait_until([val](Word cur) { return cur == val; });
+    }
+
+private:
+    std::atomic<Word> m_word;
+};
+
+
+// Default policy for the C entry points. Override at build time with
+// e.g. make WAIT_POLICY=AdaptiveWait, or only pick the backoff of the
+// default spin with e.g. make BACKOFF='ExpBackoff<>' (after make clean).
+#ifndef GTMP_WAIT_POLICY
+#ifdef GTMP_BACKOFF
+#define GTMP_WAIT_POLICY BackoffSpinWait< GTMP_BACKOFF >
+#else
+#define GTMP_WAIT_POLICY SpinWait
+#endif
+#endif
+
+using DefaultWaitPolicy = GTMP_WAIT_POLICY;
+
+#endif
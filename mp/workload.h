@@ -0,0 +1,256 @@
+#ifndef INC_WORKLOAD_H
+#define INC_WORKLOAD_H
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/assert.hpp>
+
+#include "perf_counters.h"
+
+// Work done by every thread between two crossings, in units of
+// do_private_work(). The amount is a pure function of (seed, thread, iter),
+// computed with a counter based generator: no state is shared or carried
+// between crossings, and every algorithm sees exactly the same phases for
+// the same spec and seed.
+//
+//   fixed:N                  N units for everyone
+//   uniform:MIN:MAX          uniform in [MIN, MAX], drawn per thread and phase
+//   exp:MEAN                 exponential with the given mean, per thread and phase
+//   straggler:N:EXTRA[:T]    N units, and N + EXTRA for thread T (default the last)
+//   noise:N:PERIOD:LENGTH    N units, plus LENGTH every PERIOD phases on each
+//                            thread, at a random offset per thread: periodic
+//                            interrupts as in the FWQ noise benchmark
+class Workload
+{
+public:
+
+	static Workload parse(const std::string & spec, uint64_t seed, int num_threads)
+	{
+		Workload load;
+		load.m_spec = spec;
+		load.m_seed = seed;
+
+		std::vector<std::string> fields;
+		std::istringstream iss(spec);
+		for (std::string field; std::getline(iss, field, ':'); )
+		{
+			fields.push_back(field);
+		}
+
+		auto num = [&spec, &fields](size_t i, unsigned fallback)
+		{
+			if (i >= fields.size())
+			{
+				return fallback;
+			}
+			try
+			{
+				return static_cast<unsigned>(std::stoul(fields[i]));
+			}
+			catch (const std::exception &)
+			{
+				std::cerr << "Bad number \"" + fields[i] + "\" in workload " + spec + "\n";
+				std::exit(1);
+			}
+		};
+
+		auto expect = [&spec, &fields](size_t min_fields, size_t max_fields)
+		{
+			if (fields.size() < min_fields || fields.size() > max_fields)
+			{
+				std::cerr << "Bad workload " + spec + ", see workload.h for the syntax\n";
+				std::exit(1);
+			}
+		};
+
+		const std::string kind = fields.empty() ? std::string() : fields[0];
+
+		if (kind == "fixed")
+		{
+			expect(2, 2);
+			load.m_kind = Kind::Fixed;
+			load.m_base = num(1, 0);
+		}
+		else if (kind == "uniform")
+		{
+			expect(3, 3);
+			load.m_kind = Kind::Uniform;
+			load.m_base = num(1, 0);
+			load.m_extra = num(2, 0);
+			if (load.m_extra < load.m_base)
+			{
+				std::cerr << "Bad workload " + spec + ", MAX is below MIN\n";
+				std::exit(1);
+			}
+			load.m_extra -= load.m_base;
+		}
+		else if (kind == "exp")
+		{
+			expect(2, 2);
+			load.m_kind = Kind::Exponential;
+			load.m_extra = num(1, 0);
+		}
+		else if (kind == "straggler")
+		{
+			expect(3, 4);
+			load.m_kind = Kind::Straggler;
+			load.m_base = num(1, 0);
+			load.m_extra = num(2, 0);
+			load.m_straggler = static_cast<int>(num(3, static_cast<unsigned>(num_threads - 1)));
+		}
+		else if (kind == "noise")
+		{
+			expect(4, 4);
+			load.m_kind = Kind::Noise;
+			load.m_base = num(1, 0);
+			load.m_period = std::max(num(2, 1), 1u);
+			load.m_extra = num(3, 0);
+		}
+		else
+		{
+			std::cerr << "Unknown workload " + spec + ", expected fixed, uniform, exp, straggler or noise\n";
+			std::exit(1);
+		}
+
+		return load;
+	}
+
+	static Workload fixed(unsigned units)
+	{
+		Workload load;
+		load.m_spec = "fixed:" + std::to_string(units);
+		load.m_base = units;
+		return load;
+	}
+
+	unsigned get_units(int thread_id, unsigned iter) const
+	{
+		switch (m_kind)
+		{
+		case Kind::Fixed:
+			return m_base;
+
+		case Kind::Uniform:
+			return m_base + static_cast<unsigned>(draw(thread_id, iter) % (uint64_t(m_extra) + 1));
+
+		case Kind::Exponential:
+		{
+			// 53 random bits to a double in (0, 1]
+			const double u = double((draw(thread_id, iter) >> 11) + 1) * (1.0 / 9007199254740992.0);
+			return static_cast<unsigned>(-double(m_extra) * std::log(u));
+		}
+
+		case Kind::Straggler:
+			return thread_id == m_straggler ? m_base + m_extra : m_base;
+
+		case Kind::Noise:
+		{
+			const unsigned offset = static_cast<unsigned>(draw(thread_id, 0xffffffffu) % m_period);
+			return (iter + offset) % m_period == 0 ? m_base + m_extra : m_base;
+		}
+		}
+
+		return m_base;
+	}
+
+	const std::string & get_spec() const
+	{
+		return m_spec;
+	}
+
+private:
+
+	enum class Kind
+	{
+		Fixed,
+		Uniform,
+		Exponential,
+		Straggler,
+		Noise
+	};
+
+	// splitmix64 finalizer of (seed, thread, iter)
+	uint64_t draw(int thread_id, unsigned iter) const
+	{
+		uint64_t x = m_seed * 0x9e3779b97f4a7c15ull + (uint64_t(static_cast<unsigned>(thread_id)) << 32 | iter);
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	Kind m_kind = Kind::Fixed;
+	std::string m_spec;
+	uint64_t m_seed = 1;
+	unsigned m_base = 0;
+	unsigned m_extra = 0;
+	unsigned m_period = 1;
+	int m_straggler = 0;
+};
+
+
+// Total time of a run of phases against an ideal barrier, which would
+// release everyone the moment the slowest thread of the phase is done.
+struct LoadReport
+{
+	std::string name;           // Barrier algorithm
+	std::string spec;           // Workload
+	int num_threads = 0;
+	unsigned num_iters = 0;
+	double seconds = 0;
+	double ideal_seconds = 0;
+	PerfCounts perf;            // Of the timed loop, with --perf
+
+	double get_slowdown() const
+	{
+		return seconds / ideal_seconds;
+	}
+
+	double get_lost_ns_per_phase() const
+	{
+		return (seconds - ideal_seconds) * 1e9 / num_iters;
+	}
+
+	void write_text(std::ostream & os) const
+	{
+		os << name + " under " + spec + ", " + std::to_string(num_threads) + " threads: " + std::to_string(seconds)
+			+ "s, ideal " + std::to_string(ideal_seconds) + "s (" + std::to_string(get_slowdown()) + "x), "
+			+ std::to_string(get_lost_ns_per_phase()) + "ns lost per phase\n";
+		perf.write_text(os);
+	}
+
+	void write_csv(std::ostream & os, bool with_header) const
+	{
+		if (with_header)
+		{
+			os << "algorithm,workload,threads,iters,seconds,ideal_seconds,slowdown,lost_ns_per_phase";
+			PerfCounts::write_csv_header(os);
+			os << "\n";
+		}
+		os << name + "," + spec + "," + std::to_string(num_threads) + "," + std::to_string(num_iters) + ","
+			+ std::to_string(seconds) + "," + std::to_string(ideal_seconds) + "," + std::to_string(get_slowdown()) + ","
+			+ std::to_string(get_lost_ns_per_phase());
+		perf.write_csv(os);
+		os << "\n";
+	}
+
+	void write_json(std::ostream & os) const
+	{
+		os << "{\"algorithm\": \"" + name + "\", \"workload\": \"" + spec + "\", \"threads\": " + std::to_string(num_threads)
+			+ ", \"iters\": " + std::to_string(num_iters) + ", \"seconds\": " + std::to_string(seconds)
+			+ ", \"ideal_seconds\": " + std::to_string(ideal_seconds) + ", \"slowdown\": " + std::to_string(get_slowdown())
+			+ ", \"lost_ns_per_phase\": " + std::to_string(get_lost_ns_per_phase());
+		perf.write_json(os);
+		os << "}\n";
+	}
+};
+
+#endif